@@ -18,6 +18,7 @@
 
 #include "bitboard.h"
 #include "board.h"
+#include "gentables.h"
 
 
 const Bitboard FileBB[FILE_NB] = {
@@ -28,21 +29,36 @@ const Bitboard RankBB[RANK_NB] = {
     rank1BB, rank2BB, rank3BB, rank4BB, rank5BB, rank6BB, rank7BB, rank8BB
 };
 
+#ifdef PREGEN
+    #define TABLES_BITBOARD
+#else
 Bitboard BetweenBB[64][64];
+Bitboard LineBB[64][64];
 
+Bitboard PseudoAttacks[TYPE_NB][64];
+Bitboard PawnAttacks[COLOR_NB][64];
+
+Bitboard PassedMask[COLOR_NB][64];
+Bitboard IsolatedMask[64];
+#endif
+
+// DISPATCH builds hold both a pext and a magic copy, so build slider tables at startup
+#if defined(PREGEN) && !defined(DISPATCH)
+    #define TABLES_SLIDERS
+#else
 static Bitboard BishopAttacks[5248];
 static Bitboard RookAttacks[102400];
 
 Magic BishopTable[64];
 Magic RookTable[64];
+#endif
 
-Bitboard PseudoAttacks[TYPE_NB][64];
-Bitboard PawnAttacks[COLOR_NB][64];
-
-Bitboard PassedMask[COLOR_NB][64];
-Bitboard IsolatedMask[64];
+#ifdef PREGEN
+    #include "tables.h"
+#endif
 
 
+#if !defined(PREGEN) || defined(DISPATCH)
 // Returns a bitboard with the landing square of the step,
 // or an empty bitboard if the step would go outside the board
 INLINE Bitboard LandingSquareBB(const Square sq, const int step) {
@@ -66,6 +82,9 @@ static Bitboard MakeSliderAttackBB(const Square sq, const Bitboard occupied, con
     return attacks;
 }
 
+#endif
+
+#ifndef PREGEN
 // Initializes non-slider attack lookups
 static void InitNonSliderAttacks() {
 
@@ -88,6 +107,9 @@ static void InitNonSliderAttacks() {
     }
 }
 
+#endif
+
+#if !defined(PREGEN) || defined(DISPATCH)
 // Initializes slider attack lookups
 static void InitSliderAttacks(Magic m[], Bitboard table[], const int steps[]) {
 
@@ -97,7 +119,8 @@ static void InitSliderAttacks(Magic m[], Bitboard table[], const int steps[]) {
 
     for (Square sq = A1; sq <= H8; ++sq) {
 
-        m[sq].attacks = table;
+        Bitboard *attacks = table;
+        m[sq].attacks = attacks;
 
         // Construct the mask
         Bitboard edges = ((rank1BB | rank8BB) & ~RankBB[RankOf(sq)])
@@ -113,7 +136,7 @@ static void InitSliderAttacks(Magic m[], Bitboard table[], const int steps[]) {
         // Loop through all possible combinations of occupied squares, filling the table
         Bitboard occupied = 0;
         do {
-            MagicAttacks(sq, occupied, m) = MakeSliderAttackBB(sq, occupied, steps);
+            attacks[AttackIndex(sq, occupied, m)] = MakeSliderAttackBB(sq, occupied, steps);
             occupied = (occupied - m[sq].mask) & m[sq].mask; // Carry rippler
             table++;
         } while (occupied);
@@ -123,19 +146,21 @@ static void InitSliderAttacks(Magic m[], Bitboard table[], const int steps[]) {
 // Initializes all bitboard lookups
 CONSTR(2) InitBitboards() {
 
-    InitNonSliderAttacks();
-
     const int BSteps[4] = { 7, 9, -7, -9 };
     const int RSteps[4] = { 8, 1, -8, -1 };
 
     InitSliderAttacks(BishopTable, BishopAttacks, BSteps);
     InitSliderAttacks(  RookTable,   RookAttacks, RSteps);
 
+#ifndef PREGEN
+    InitNonSliderAttacks();
+
     for (Square sq1 = A1; sq1 <= H8; sq1++)
         for (Square sq2 = A1; sq2 <= H8; sq2++)
             for (PieceType pt = BISHOP; pt <= ROOK; pt++)
                 if (AttackBB(pt, sq1, BB(sq2)) & BB(sq2))
-                    BetweenBB[sq1][sq2] = AttackBB(pt, sq1, BB(sq2)) & AttackBB(pt, sq2, BB(sq1));
+                    BetweenBB[sq1][sq2] = AttackBB(pt, sq1, BB(sq2)) & AttackBB(pt, sq2, BB(sq1)),
+                    LineBB[sq1][sq2] = (AttackBB(pt, sq1, 0) & AttackBB(pt, sq2, 0)) | BB(sq1) | BB(sq2);
 
     for (Square sq = A1; sq <= H8; ++sq) {
 
@@ -147,6 +172,51 @@ CONSTR(2) InitBitboards() {
         PassedMask[BLACK][sq] = ShiftBB(~rank8BB, SOUTH * RelativeRank(BLACK, RankOf(sq)))
                               & (FileBB[FileOf(sq)] | AdjacentFilesBB(sq));
     }
+#endif
+}
+#endif
+
+void PrintBitboardTables() {
+    PrintTable("const Bitboard BetweenBB[64][64]", BetweenBB, sizeof(Bitboard), false, 2, 64, 64);
+    PrintTable("const Bitboard LineBB[64][64]", LineBB, sizeof(Bitboard), false, 2, 64, 64);
+    PrintTable("const Bitboard PseudoAttacks[TYPE_NB][64]", PseudoAttacks, sizeof(Bitboard), false, 2, TYPE_NB, 64);
+    PrintTable("const Bitboard PawnAttacks[COLOR_NB][64]", PawnAttacks, sizeof(Bitboard), false, 2, COLOR_NB, 64);
+    PrintTable("const Bitboard PassedMask[COLOR_NB][64]", PassedMask, sizeof(Bitboard), false, 2, COLOR_NB, 64);
+    PrintTable("const Bitboard IsolatedMask[64]", IsolatedMask, sizeof(Bitboard), false, 1, 64);
+}
+
+// Prints the magic (or pext) lookup for each square, pointing into the attack table
+static void PrintMagics(const char *name, const Magic *m, const char *tableName, const Bitboard *table) {
+
+    printf("const Magic %s[64] = {\n", name);
+
+    for (Square sq = A1; sq <= H8; ++sq) {
+        printf("    { %s + %6d, 0x%016" PRIX64 "ull", tableName, (int)(m[sq].attacks - table), m[sq].mask);
+#ifndef USE_PEXT
+        printf(", 0x%016" PRIX64 "ull, %2d", m[sq].magic, m[sq].shift);
+#endif
+        printf(" },\n");
+    }
+
+    printf("};\n\n");
+}
+
+void PrintSliderTables() {
+
+    // The layout of the slider tables depends on whether pext is used
+#if defined(DISPATCH)
+    printf("#error \"Slider tables can't be generated by a DISPATCH build\"\n\n");
+#elif defined(USE_PEXT)
+    printf("#ifndef USE_PEXT\n#error \"tables.h was generated for pext, regenerate it\"\n#endif\n\n");
+#else
+    printf("#ifdef USE_PEXT\n#error \"tables.h was generated for magics, regenerate it\"\n#endif\n\n");
+#endif
+
+    PrintTable("static const Bitboard BishopAttacks[5248]", BishopAttacks, sizeof(Bitboard), false, 1, 5248);
+    PrintTable("static const Bitboard RookAttacks[102400]", RookAttacks, sizeof(Bitboard), false, 1, 102400);
+
+    PrintMagics("BishopTable", BishopTable, "BishopAttacks", BishopAttacks);
+    PrintMagics(  "RookTable",   RookTable,   "RookAttacks",   RookAttacks);
 }
 
 // Returns a bitboard with all attackers of a square
@@ -180,3 +250,23 @@ bool SqAttacked(const Position *pos, const Square sq, const Color color) {
 bool KingAttacked(const Position *pos, const Color color) {
     return SqAttacked(pos, kingSq(color), !color);
 }
+
+// Returns the pieces of the given color pinned to their own king
+Bitboard Pinned(const Position *pos, const Color color) {
+
+    const Square king = kingSq(color);
+    const Bitboard enemies = colorBB(!color);
+
+    // Enemy sliders that would attack the king if not for one blocking piece
+    Bitboard pinners = enemies & (  (AttackBB(BISHOP, king, enemies) & (pieceBB(BISHOP) | pieceBB(QUEEN)))
+                                  | (AttackBB(ROOK,   king, enemies) & (pieceBB(ROOK)   | pieceBB(QUEEN))));
+    Bitboard pinned = 0;
+
+    while (pinners) {
+        Bitboard blockers = BetweenBB[king][PopLsb(&pinners)] & pieceBB(ALL);
+        if (Single(blockers))
+            pinned |= blockers & colorBB(color);
+    }
+
+    return pinned;
+}
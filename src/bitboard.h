@@ -73,7 +73,7 @@ static const uint64_t BishopMagics[64] = {
 #define MagicAttacks(sq, occ, table) (table[sq].attacks[AttackIndex(sq, occ, table)])
 
 typedef struct {
-    Bitboard *attacks;
+    const Bitboard *attacks;
     Bitboard mask;
 #ifndef USE_PEXT
     uint64_t magic;
@@ -109,16 +109,22 @@ enum {
 extern const Bitboard FileBB[FILE_NB];
 extern const Bitboard RankBB[RANK_NB];
 
-extern Bitboard BetweenBB[64][64];
+extern TABLE Bitboard BetweenBB[64][64];
+extern TABLE Bitboard LineBB[64][64];
 
+#if defined(PREGEN) && !defined(DISPATCH)
+extern const Magic BishopTable[64];
+extern const Magic RookTable[64];
+#else
 extern Magic BishopTable[64];
 extern Magic RookTable[64];
+#endif
 
-extern Bitboard PseudoAttacks[TYPE_NB][64];
-extern Bitboard PawnAttacks[COLOR_NB][64];
+extern TABLE Bitboard PseudoAttacks[TYPE_NB][64];
+extern TABLE Bitboard PawnAttacks[COLOR_NB][64];
 
-extern Bitboard PassedMask[COLOR_NB][64];
-extern Bitboard IsolatedMask[64];
+extern TABLE Bitboard PassedMask[COLOR_NB][64];
+extern TABLE Bitboard IsolatedMask[64];
 
 
 // Shifts a bitboard (protonspring version)
@@ -222,6 +228,7 @@ INLINE Bitboard PawnBBAttackBB(Bitboard pawns, Color color) {
 Bitboard Attackers(const Position *pos, const Square sq, const Bitboard occ);
 bool SqAttacked(const Position *pos, Square sq, Color color);
 bool KingAttacked(const Position *pos, Color color);
+Bitboard Pinned(const Position *pos, Color color);
 
 // Returns a bitboard with all pieces checking the king of the current side to move
 INLINE Bitboard Checkers(const Position *pos) {
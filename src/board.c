@@ -23,23 +23,31 @@
 #include "bitboard.h"
 #include "board.h"
 #include "evaluate.h"
+#include "gentables.h"
 #include "move.h"
 #include "psqt.h"
 
 
 bool Chess960 = false;
 
+#ifdef PREGEN
+    #define TABLES_BOARD
+    #include "tables.h"
+#else
 uint8_t SqDistance[64][64];
+#endif
 
 const int NonPawn[PIECE_NB] = {
     false, false,  true,  true,  true,  true, false, false,
     false, false,  true,  true,  true,  true, false, false
 };
 
+#ifndef PREGEN
 // Zobrist key tables
 uint64_t PieceKeys[PIECE_NB][64];
 uint64_t CastleKeys[16];
 uint64_t SideKey;
+#endif
 
 static const char PieceChars[] = ".PNBRQK..pnbrqk";
 
@@ -48,6 +56,7 @@ Bitboard CastlePath[16];
 Square RookSquare[16];
 
 
+#ifndef PREGEN
 // Initialize distance lookup table
 CONSTR(1) InitDistance() {
     for (Square sq1 = A1; sq1 <= H8; ++sq1)
@@ -57,9 +66,11 @@ CONSTR(1) InitDistance() {
             SqDistance[sq1][sq2] = MAX(vertical, horizontal);
         }
 }
+#endif
 
 int Distance(Square sq1, Square sq2) { return SqDistance[sq1][sq2]; }
 
+#ifndef PREGEN
 // Pseudo-random number generator
 static uint64_t Rand64() {
 
@@ -98,6 +109,7 @@ CONSTR(1) InitHashKeys() {
     for (int i = 0; i < 16; ++i)
         CastleKeys[i] = Rand64();
 }
+#endif
 
 // Generates a hash key from scratch
 static Key GenPosKey(const Position *pos) {
@@ -375,12 +387,13 @@ bool SEE(const Position *pos, const Move move, const int threshold) {
     return side != ColorOf(pieceOn(from));
 }
 
-static Key cuckoo[8192];
-static Move cuckooMove[8192];
-
 INLINE uint32_t Hash1(Key hash) { return  hash        & 0x1fff; }
 INLINE uint32_t Hash2(Key hash) { return (hash >> 16) & 0x1fff; }
 
+#ifndef PREGEN
+static Key cuckoo[8192];
+static Move cuckooMove[8192];
+
 #define Swap(x, y) {    \
     typeof(x) temp = x; \
     x = y;              \
@@ -419,6 +432,16 @@ CONSTR(3) InitCuckoo() {
     if (validate != 3668)
         puts("Failed to set cuckoo tables."), exit(1);
 }
+#endif
+
+void PrintBoardTables() {
+    PrintTable("const uint8_t SqDistance[64][64]", SqDistance, sizeof(uint8_t), false, 2, 64, 64);
+    PrintTable("const uint64_t PieceKeys[PIECE_NB][64]", PieceKeys, sizeof(uint64_t), false, 2, PIECE_NB, 64);
+    PrintTable("const uint64_t CastleKeys[16]", CastleKeys, sizeof(uint64_t), false, 1, 16);
+    PrintTable("const uint64_t SideKey", &SideKey, sizeof(uint64_t), false, 0);
+    PrintTable("static const Key cuckoo[8192]", cuckoo, sizeof(Key), false, 1, 8192);
+    PrintTable("static const Move cuckooMove[8192]", cuckooMove, sizeof(Move), false, 1, 8192);
+}
 
 // Upcoming repetition detection
 bool HasCycle(const Position *pos, int ply) {
@@ -31,6 +31,8 @@ typedef struct {
     int castlingRights;
 } History;
 
+typedef struct Accumulator Accumulator;
+
 typedef struct Position {
     uint8_t board[64];
     Bitboard pieceBB[7];
@@ -54,10 +56,15 @@ typedef struct Position {
     Key materialKey;
     Key pawnKey;
 
-    uint64_t nodes;
     int trend;
 
+    // Top of the NNUE accumulator stack, or NULL with the classical eval
+    Accumulator *acc;
+
     History gameHistory[256];
+
+    // Incremented every node, so kept on a cache line of its own
+    CACHE_PAD uint64_t nodes;
 } Position;
 
 
@@ -66,9 +73,9 @@ extern bool Chess960;
 extern const int NonPawn[PIECE_NB];
 
 // Zobrist keys
-extern uint64_t PieceKeys[PIECE_NB][64];
-extern uint64_t CastleKeys[16];
-extern uint64_t SideKey;
+extern TABLE uint64_t PieceKeys[PIECE_NB][64];
+extern TABLE uint64_t CastleKeys[16];
+extern TABLE uint64_t SideKey;
 
 extern uint8_t CastlePerm[64];
 extern Bitboard CastlePath[16];
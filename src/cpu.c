@@ -0,0 +1,82 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <cpuid.h>
+#endif
+
+#include "cpu.h"
+
+
+CPUFeatures CPU = {
+#ifdef __POPCNT__
+    .popcnt = true,
+#endif
+#ifdef USE_PEXT
+    .pext   = true,
+#endif
+#ifdef __SSE4_1__
+    .sse41  = true,
+#endif
+#ifdef __AVX2__
+    .avx2   = true,
+#endif
+};
+
+// Describes the code paths in use
+const char *CPUPath() {
+
+    static char path[64];
+
+    sprintf(path, "%s %s %s%s",
+            CPU.pext   ? "pext"   : "magic",
+            CPU.popcnt ? "popcnt" : "no-popcnt",
+            CPU.avx2   ? "avx2"   : CPU.sse41 ? "sse4.1" : "scalar",
+#ifdef DISPATCH
+            " (dispatch)");
+#else
+            "");
+#endif
+
+    return path;
+}
+
+// Returns the processor name reported by cpuid
+const char *CPUBrand() {
+
+    static char brand[49] = "unknown";
+
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int regs[12];
+
+    if (__get_cpuid_max(0x80000000, NULL) >= 0x80000004) {
+        for (int i = 0; i < 3; ++i)
+            __get_cpuid(0x80000002 + i, &regs[4*i], &regs[4*i+1], &regs[4*i+2], &regs[4*i+3]);
+        memcpy(brand, regs, 48);
+    }
+#endif
+
+    // Some cpus pad the name with leading spaces
+    char *name = brand;
+    while (*name == ' ') name++;
+
+    return name;
+}
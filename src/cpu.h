@@ -0,0 +1,38 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "types.h"
+
+
+// Instruction set extensions used by the hot kernels, fixed by the flags the
+// binary (or in DISPATCH builds, the copy picked at startup) was compiled with
+typedef struct CPUFeatures {
+    bool popcnt;
+    bool pext;   // bmi2, but not on Zen 1/2 where pext is very slow
+    bool sse41;
+    bool avx2;
+} CPUFeatures;
+
+
+extern CPUFeatures CPU;
+
+
+const char *CPUBrand();
+const char *CPUPath();
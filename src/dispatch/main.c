@@ -0,0 +1,50 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Entry point of DISPATCH builds. The engine is linked in once per instruction
+// set, with every symbol of a copy suffixed by its name, see the Makefile
+
+
+int main_generic(int argc, char **argv);
+int main_popcnt(int argc, char **argv);
+int main_avx2(int argc, char **argv);
+int main_pext(int argc, char **argv);
+
+
+// Runs the fastest copy of the engine this cpu supports
+int main(int argc, char **argv) {
+
+    __builtin_cpu_init();
+
+    const int popcnt = __builtin_cpu_supports("popcnt")
+                    && __builtin_cpu_supports("sse4.1");
+    const int avx2   = popcnt
+                    && __builtin_cpu_supports("avx2")
+                    && __builtin_cpu_supports("bmi");
+
+    // Pext is very slow on Zen 1/2
+    const int pext   = avx2
+                    && __builtin_cpu_supports("bmi2")
+                    && !__builtin_cpu_is("znver1")
+                    && !__builtin_cpu_is("znver2");
+
+    return pext   ? main_pext(argc, argv)
+         : avx2   ? main_avx2(argc, argv)
+         : popcnt ? main_popcnt(argc, argv)
+                  : main_generic(argc, argv);
+}
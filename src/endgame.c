@@ -22,8 +22,25 @@
 #include <string.h>
 
 #include "endgame.h"
+#include "gentables.h"
 
 
+static int TrivialDraw(__attribute__((unused)) const Position *pos, __attribute__((unused)) Color color) {
+    return 0;
+}
+
+// Names of the specialized evals, for printing the table
+static const struct {
+    SpecializedEval evalFunc;
+    const char *name;
+} EvalNames[] = {
+    { &TrivialDraw, "TrivialDraw" },
+};
+
+#ifdef PREGEN
+    #define TABLES_ENDGAME
+    #include "tables.h"
+#else
 Endgame EndgameTable[ENDGAME_TABLE_SIZE] = { 0 };
 
 
@@ -42,10 +59,6 @@ static Key GenMaterialKey(const char *white, const char *black) {
     return pos.materialKey;
 }
 
-static int TrivialDraw(__attribute__((unused)) const Position *pos, __attribute__((unused)) Color color) {
-    return 0;
-}
-
 static void AddEndgame(const char *white, const char *black, SpecializedEval ef) {
 
     Key key = GenMaterialKey(white, black);
@@ -80,3 +93,26 @@ CONSTR(3) InitEndgames() {
     AddEndgame("KNN", "k", &TrivialDraw);
     AddEndgame("K", "knn", &TrivialDraw);
 }
+#endif
+
+void PrintEndgameTables() {
+
+    printf("const Endgame EndgameTable[ENDGAME_TABLE_SIZE] = {\n");
+
+    for (int i = 0; i < ENDGAME_TABLE_SIZE; ++i) {
+
+        const Endgame *eg = &EndgameTable[i];
+        if (eg->evalFunc == NULL) continue;
+
+        const char *name = NULL;
+        for (size_t j = 0; j < sizeof(EvalNames) / sizeof(EvalNames[0]); ++j)
+            if (EvalNames[j].evalFunc == eg->evalFunc)
+                name = EvalNames[j].name;
+
+        assert(name != NULL);
+
+        printf("    [%2d] = { 0x%016" PRIX64 "ull, &%s },\n", i, eg->key, name);
+    }
+
+    printf("};\n\n");
+}
@@ -33,7 +33,7 @@ typedef struct Endgame {
 } Endgame;
 
 
-extern Endgame EndgameTable[ENDGAME_TABLE_SIZE];
+extern TABLE Endgame EndgameTable[ENDGAME_TABLE_SIZE];
 
 
 INLINE int EndgameIndex(Key materialKey) {
@@ -22,6 +22,7 @@
 #include "bitboard.h"
 #include "evaluate.h"
 #include "endgame.h"
+#include "nnue.h"
 
 
 typedef struct EvalInfo {
@@ -215,22 +216,34 @@ INLINE int EvalPawns(const Position *pos, EvalInfo *ei, const Color color) {
     return eval;
 }
 
+// Multiplying spreads every bit of the eval and passers into the upper half,
+// so a torn entry can't cancel out against the key the way plain xor can
+INLINE uint32_t PawnCheck(Key key, int32_t eval, Bitboard passedPawns) {
+    return (uint32_t)((key ^ eval * 0x9E3779B97F4A7C15ull ^ passedPawns * 0xC2B2AE3D27D4EB4Full) >> 32);
+}
+
 // Tries to get pawn eval from cache, otherwise evaluates and saves
-static int ProbePawnCache(const Position *pos, EvalInfo *ei, PawnCache pc) {
+static int ProbePawnCache(const Position *pos, EvalInfo *ei, PawnCache *pc) {
 
     // Can't cache when tuning as full trace is needed
     if (TRACE) return EvalPawns(pos, ei, WHITE) - EvalPawns(pos, ei, BLACK);
 
     Key key = pos->pawnKey;
-    PawnEntry *pe = &pc[key % PAWN_CACHE_SIZE];
+    PawnEntry *pe = &pc->table[key & pc->mask];
+    PawnEntry entry = *pe;
 
-    if (pe->key != key) {
-        pe->key  = key;
-        pe->eval = EvalPawns(pos, ei, WHITE) - EvalPawns(pos, ei, BLACK);
-        pe->passedPawns = ei->passedPawns;
+    if (entry.check == PawnCheck(key, entry.eval, entry.passedPawns)) {
+        pc->hits++;
+        return ei->passedPawns = entry.passedPawns, entry.eval;
     }
 
-    return ei->passedPawns = pe->passedPawns, pe->eval;
+    pc->misses++;
+    entry.eval = EvalPawns(pos, ei, WHITE) - EvalPawns(pos, ei, BLACK);
+    entry.passedPawns = ei->passedPawns;
+    entry.check = PawnCheck(key, entry.eval, entry.passedPawns);
+    *pe = entry;
+
+    return entry.eval;
 }
 
 // Evaluates knights, bishops, rooks, or queens
@@ -522,13 +535,16 @@ static int ScaleFactor(const Position *pos, const int eval) {
 }
 
 // Calculate a static evaluation of a position
-int EvalPosition(const Position *pos, PawnCache pc) {
+int EvalPosition(const Position *pos, PawnCache *pc) {
 
-    Endgame *eg = &EndgameTable[EndgameIndex(pos->materialKey)];
+    const Endgame *eg = &EndgameTable[EndgameIndex(pos->materialKey)];
 
     if (eg->key == pos->materialKey && eg->evalFunc != NULL)
         return eg->evalFunc(pos, sideToMove);
 
+    if (pos->acc)
+        return EvalNNUE(pos);
+
     EvalInfo ei;
     InitEvalInfo(pos, &ei, WHITE);
     InitEvalInfo(pos, &ei, BLACK);
@@ -564,3 +580,20 @@ int EvalPosition(const Position *pos, PawnCache pc) {
     // Return the evaluation, negated if we are black + tempo bonus
     return (sideToMove == WHITE ? eval : -eval) + Tempo;
 }
+
+// Probes the eval cache before evaluating. The trend is part
+// of the eval, so it is mixed into the key
+int CachedEval(const Position *pos, EvalCache *ec, PawnCache *pc) {
+
+    Key key = pos->key ^ (uint32_t)pos->trend * 0x9E3779B97F4A7C15ull;
+    EvalEntry *entry = &ec->table[key & (EVAL_CACHE_SIZE - 1)];
+
+    if (entry->key == (uint32_t)(key >> 32))
+        return ec->hits++, entry->eval;
+
+    ec->misses++;
+    entry->key  = key >> 32;
+    entry->eval = EvalPosition(pos, pc);
+
+    return entry->eval;
+}
@@ -22,15 +22,35 @@
 #include "types.h"
 
 
-#define PAWN_CACHE_SIZE 128 * 1024
+#define PAWN_CACHE_DEFAULT 2
 
+// The check combines the upper key bits with the data,
+// so entries torn by concurrent writes are rejected
 typedef struct PawnEntry {
-    Key key;
+    uint32_t check;
+    int32_t eval;
     Bitboard passedPawns;
-    int eval;
 } PawnEntry;
 
-typedef PawnEntry PawnCache[PAWN_CACHE_SIZE];
+typedef struct PawnCache {
+    PawnEntry *table;
+    uint64_t mask;
+    uint64_t hits;
+    uint64_t misses;
+} PawnCache;
+
+#define EVAL_CACHE_SIZE (64 * 1024)
+
+typedef struct EvalEntry {
+    uint32_t key;
+    int32_t eval;
+} EvalEntry;
+
+typedef struct EvalCache {
+    EvalEntry table[EVAL_CACHE_SIZE];
+    uint64_t hits;
+    uint64_t misses;
+} EvalCache;
 
 
 extern const int Tempo;
@@ -53,10 +73,13 @@ INLINE int UpdatePhase(int value) {
 }
 
 // Returns a static evaluation of the position from the side to move's point of view
-int EvalPosition(const Position *pos, PawnCache pc);
+int EvalPosition(const Position *pos, PawnCache *pc);
+
+// Returns a cached static evaluation if there is one, otherwise evaluates and caches it
+int CachedEval(const Position *pos, EvalCache *ec, PawnCache *pc);
 
 // Returns a static evaluation of the position from whites point of view
-INLINE int EvalPositionWhitePov(const Position *pos, PawnCache pc) {
+INLINE int EvalPositionWhitePov(const Position *pos, PawnCache *pc) {
     int score = EvalPosition(pos, pc);
     return sideToMove == WHITE ? score : -score;
 }
@@ -0,0 +1,112 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+
+#include "gentables.h"
+
+
+// Prints a single value of the given size
+static void PrintValue(const void *value, int size, bool isSigned) {
+
+    int64_t s = 0;
+    uint64_t u = 0;
+
+    switch (size) {
+        case 1: s = *(const  int8_t *)value; u = *(const  uint8_t *)value; break;
+        case 2: s = *(const int16_t *)value; u = *(const uint16_t *)value; break;
+        case 4: s = *(const int32_t *)value; u = *(const uint32_t *)value; break;
+        case 8: s = *(const int64_t *)value; u = *(const uint64_t *)value; break;
+    }
+
+    if (size == 8 && !isSigned)
+        printf("0x%016" PRIX64 "ull", u);
+    else if (isSigned)
+        printf("%" PRId64, s);
+    else
+        printf("%" PRIu64, u);
+}
+
+// Prints the values of one dimension of a table, recursing into the next
+static const char *PrintValues(const char *data, int size, bool isSigned, const int *dims, int dimCount, int indent) {
+
+    const int perLine = size == 8 ? 4 : 16;
+
+    printf("{");
+
+    if (dimCount == 1) {
+        for (int i = 0; i < dims[0]; ++i, data += size) {
+            if (i % perLine) printf(" ");
+            else             printf("\n%*s", indent + 4, "");
+            PrintValue(data, size, isSigned);
+            printf(",");
+        }
+    } else {
+        for (int i = 0; i < dims[0]; ++i) {
+            printf("\n%*s", indent + 4, "");
+            data = PrintValues(data, size, isSigned, dims + 1, dimCount - 1, indent + 4);
+            printf(",");
+        }
+    }
+
+    printf("\n%*s}", indent, "");
+
+    return data;
+}
+
+// Prints the definition of a table of integers with the given dimensions,
+// or a single integer if there are none
+void PrintTable(const char *decl, const void *table, int size, bool isSigned, int dimCount, ...) {
+
+    int dims[8];
+
+    va_list args;
+    va_start(args, dimCount);
+    for (int i = 0; i < dimCount; ++i)
+        dims[i] = va_arg(args, int);
+    va_end(args);
+
+    printf("%s = ", decl);
+
+    if (dimCount)
+        PrintValues(table, size, isSigned, dims, dimCount, 0);
+    else
+        PrintValue(table, size, isSigned);
+
+    printf(";\n\n");
+}
+
+// Wraps a module's tables so it can include only its own
+static void PrintSection(const char *name, void (*print)()) {
+    printf("#ifdef %s\n\n", name);
+    print();
+    printf("#endif\n\n");
+}
+
+// Prints all pregenerated tables as a C header
+void GenerateTables() {
+
+    printf("// Generated by 'weiss gentables', do not edit\n\n");
+
+    PrintSection("TABLES_BITBOARD", PrintBitboardTables);
+    PrintSection("TABLES_SLIDERS",  PrintSliderTables);
+    PrintSection("TABLES_BOARD",    PrintBoardTables);
+    PrintSection("TABLES_ENDGAME",  PrintEndgameTables);
+    PrintSection("TABLES_PSQT",     PrintPSQTTables);
+    PrintSection("TABLES_SEARCH",   PrintSearchTables);
+}
@@ -0,0 +1,37 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "types.h"
+
+
+/* 'weiss gentables > tables.h' prints the lookup tables that are otherwise
+   computed at startup. Building with -DPREGEN compiles them in as constants
+   instead, each module including its own section of tables.h. */
+
+void GenerateTables();
+
+void PrintTable(const char *decl, const void *table, int size, bool isSigned, int dimCount, ...);
+
+void PrintBitboardTables();
+void PrintSliderTables();
+void PrintBoardTables();
+void PrintEndgameTables();
+void PrintPSQTTables();
+void PrintSearchTables();
@@ -21,6 +21,7 @@
 #include "evaluate.h"
 #include "makemove.h"
 #include "move.h"
+#include "nnue.h"
 #include "psqt.h"
 #include "transposition.h"
 
@@ -44,6 +45,9 @@ static void ClearPiece(Position *pos, const Square sq, const bool hash) {
     if (hash)
         HASH_PCE(piece, sq);
 
+    if (hash && pos->acc)
+        RecordDelta(pos, piece, sq, false);
+
     if (PieceTypeOf(piece) == PAWN)
         pos->pawnKey ^= PieceKeys[piece][sq];
 
@@ -78,6 +82,9 @@ static void AddPiece(Position *pos, const Square sq, const Piece piece, const bo
     if (hash)
         HASH_PCE(piece, sq);
 
+    if (hash && pos->acc)
+        RecordDelta(pos, piece, sq, true);
+
     pos->materialKey ^= PieceKeys[piece][PieceCount(pos, piece)];
 
     if (PieceTypeOf(piece) == PAWN)
@@ -117,6 +124,10 @@ static void MovePiece(Position *pos, const Square from, const Square to, const b
         HASH_PCE(piece, from),
         HASH_PCE(piece, to);
 
+    if (hash && pos->acc)
+        RecordDelta(pos, piece, from, false),
+        RecordDelta(pos, piece, to, true);
+
     if (PieceTypeOf(piece) == PAWN)
         pos->pawnKey ^= PieceKeys[piece][from] ^ PieceKeys[piece][to];
 
@@ -190,6 +201,10 @@ done:
     pos->rule50         = history(0).rule50;
     pos->castlingRights = history(0).castlingRights;
 
+    // Back to the accumulator of the previous ply
+    if (pos->acc)
+        pos->acc--;
+
     assert(PositionOk(pos));
 }
 
@@ -211,6 +226,12 @@ bool MakeMove(Position *pos, const Move move) {
     pos->histPly++;
     pos->rule50++;
 
+    // Features are relative to the king, a king move means a refresh
+    if (pos->acc) {
+        PushAccumulator(pos);
+        pos->acc->refresh[sideToMove] = PieceTypeOf(piece(move)) == KING;
+    }
+
     // Hash out en passant if there was one, and unset it
     HASH_EP;
     pos->epSquare = 0;
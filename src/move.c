@@ -71,6 +71,37 @@ bool MoveIsPseudoLegal(const Position *pos, const Move move) {
     return BB(to) & AttackBB(pieceTypeOn(from), from, pieceBB(ALL));
 }
 
+// Checks whether a pseudo-legal move leaves the own king safe, given the pinned pieces
+bool MoveIsLegal(const Position *pos, const Move move, const Bitboard pinned) {
+
+    const Color color = sideToMove;
+    const Square from = fromSq(move);
+    const Square to = toSq(move);
+    const Square king = kingSq(color);
+
+    // Castling is fully checked during generation
+    if (moveIsCastle(move))
+        return true;
+
+    // The king can't move to an attacked square, including squares
+    // behind it along the line of a checking slider
+    if (from == king)
+        return !(Attackers(pos, to, pieceBB(ALL) ^ BB(from)) & colorBB(!color));
+
+    // En passant removes two pieces from a rank, check for sliders behind them
+    if (moveIsEnPas(move)) {
+        Bitboard occupied = (pieceBB(ALL) ^ BB(from) ^ BB(to ^ 8)) | BB(to);
+        Bitboard bishops = colorBB(!color) & (pieceBB(BISHOP) | pieceBB(QUEEN));
+        Bitboard rooks   = colorBB(!color) & (pieceBB(ROOK)   | pieceBB(QUEEN));
+
+        return !(AttackBB(BISHOP, king, occupied) & bishops)
+            && !(AttackBB(ROOK,   king, occupied) & rooks);
+    }
+
+    // Pinned pieces may only move along the pin
+    return !(pinned & BB(from)) || (LineBB[king][from] & BB(to));
+}
+
 // Translates a move to a string
 char *MoveToStr(const Move move) {
 
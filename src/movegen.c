@@ -174,22 +174,33 @@ void GenAllMoves(const Position *pos, MoveList *list) {
     GenQuietMoves(pos, list);
 }
 
+// Generates only legal moves. The pseudo-legal generators already restrict
+// non-king moves to evasions when in check, leaving pins and king safety
+void GenLegalMoves(const Position *pos, MoveList *list) {
+
+    const int first = list->count;
+    GenAllMoves(pos, list);
+
+    const Bitboard pinned = Pinned(pos, sideToMove);
+    int legal = first;
+
+    for (int i = first; i < list->count; ++i)
+        if (MoveIsLegal(pos, list->moves[i].move, pinned))
+            list->moves[legal++] = list->moves[i];
+
+    list->count = legal;
+}
+
 // Counts the number of legal moves in the position filtered by searchmoves
 int LegalMoveCount(Position *pos, Move searchmoves[]) {
     int rootMoveCount = 0;
 
     MoveList list;
     list.count = list.next = 0;
-    GenAllMoves(pos, &list);
-
-    for (int i = 0; i < list.count; ++i) {
-        Move move = list.moves[list.next++].move;
-        if (NotInSearchMoves(searchmoves, move)) continue;
-        if (!MakeMove(pos, move)) continue;
-        ++rootMoveCount;
-        TakeMove(pos);
-    }
-    pos->nodes = 0;
+    GenLegalMoves(pos, &list);
+
+    for (int i = 0; i < list.count; ++i)
+        rootMoveCount += !NotInSearchMoves(searchmoves, list.moves[i].move);
 
     return rootMoveCount;
 }
@@ -37,4 +37,5 @@ typedef struct {
 void GenNoisyMoves(const Position *pos, MoveList *list);
 void GenQuietMoves(const Position *pos, MoveList *list);
 void GenAllMoves(const Position *pos, MoveList *list);
+void GenLegalMoves(const Position *pos, MoveList *list);
 int LegalMoveCount(Position *pos, Move searchmoves[]);
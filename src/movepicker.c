@@ -72,6 +72,20 @@ static void ScoreMoves(MovePicker *mp, const int stage) {
     SortMoves(list, -1835 * mp->depth);
 }
 
+// Drops illegal moves from the scored moves when in check, keeping the order of the rest
+static void DropIllegalMoves(MovePicker *mp) {
+
+    const Position *pos = &mp->thread->pos;
+    MoveList *list = &mp->list;
+    int legal = list->next;
+
+    for (int i = list->next; i < list->count; ++i)
+        if (MoveIsLegal(pos, list->moves[i].move, mp->pinned))
+            list->moves[legal++] = list->moves[i];
+
+    list->count = legal;
+}
+
 // Returns the next move to try in a position
 Move NextMove(MovePicker *mp) {
 
@@ -90,6 +104,7 @@ Move NextMove(MovePicker *mp) {
         case GEN_NOISY:
             GenNoisyMoves(pos, &mp->list);
             ScoreMoves(mp, GEN_NOISY);
+            if (mp->evasion) DropIllegalMoves(mp);
             mp->stage++;
 
             // fall through
@@ -120,9 +135,11 @@ Move NextMove(MovePicker *mp) {
 
             // fall through
         case GEN_QUIET:
-            if (!mp->onlyNoisy)
-                GenQuietMoves(pos, &mp->list),
+            if (!mp->onlyNoisy) {
+                GenQuietMoves(pos, &mp->list);
                 ScoreMoves(mp, GEN_QUIET);
+                if (mp->evasion) DropIllegalMoves(mp);
+            }
 
             mp->stage++;
 
@@ -159,6 +176,7 @@ void InitNormalMP(MovePicker *mp, Thread *thread, Stack *ss, Depth depth, Move t
     mp->bads      = 0;
     mp->threshold = 0;
     mp->onlyNoisy = false;
+    mp->evasion   = false;
 }
 
 // Init noisy movepicker
@@ -171,3 +189,10 @@ void InitProbcutMP(MovePicker *mp, Thread *thread, Stack *ss, int threshold) {
     InitNoisyMP(mp, thread, ss, NOMOVE);
     mp->threshold = threshold;
 }
+
+// Init movepicker for positions in check, which only generates legal moves
+void InitEvasionMP(MovePicker *mp, Thread *thread, Stack *ss, Depth depth, Move ttMove, Move kill1, Move kill2) {
+    InitNormalMP(mp, thread, ss, depth, ttMove, kill1, kill2);
+    mp->evasion = true;
+    mp->pinned  = Pinned(&thread->pos, thread->pos.stm);
+}
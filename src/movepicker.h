@@ -35,6 +35,8 @@ typedef struct MovePicker {
     int bads;
     int threshold;
     bool onlyNoisy;
+    bool evasion;
+    Bitboard pinned;
 } MovePicker;
 
 
@@ -42,3 +44,4 @@ Move NextMove(MovePicker *mp);
 void InitNormalMP(MovePicker *mp, Thread *thread, Stack *ss, Depth depth, Move ttMove, Move kill1, Move kill2);
 void InitNoisyMP(MovePicker *mp, Thread *thread, Stack *ss, Move ttMove);
 void InitProbcutMP(MovePicker *mp, Thread *thread, Stack *ss, int threshold);
+void InitEvasionMP(MovePicker *mp, Thread *thread, Stack *ss, Depth depth, Move ttMove, Move kill1, Move kill2);
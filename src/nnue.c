@@ -0,0 +1,212 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    #include <immintrin.h>
+#endif
+
+#include "bitboard.h"
+#include "nnue.h"
+
+
+#define QA    255 // Feature transformer output is clipped to [0, QA]
+#define QB    64  // Output weights are scaled by QB
+#define SCALE 400 // Output is scaled to centipawns
+
+
+bool UseNNUE = false;
+
+static _Alignas(64) int16_t FeatureWeights[NNUE_INPUTS][NNUE_HIDDEN];
+static _Alignas(64) int16_t FeatureBiases[NNUE_HIDDEN];
+static _Alignas(64) int16_t OutputWeights[2 * NNUE_HIDDEN];
+static int16_t OutputBias;
+
+
+// Index of a piece on a square from the perspective of one side, given that side's king square
+INLINE int FeatureIndex(const Color color, const Square king, const Piece piece, const Square sq) {
+
+    const Square relKing = RelativeSquare(color, king);
+    const int mirror = FileOf(relKing) >= 4 ? 7 : 0;
+    const int bucket = RankOf(relKing) * 4 + (FileOf(relKing) ^ mirror);
+    const int type = (ColorOf(piece) != color) * 6 + PieceTypeOf(piece) - 1;
+
+    return (bucket * 12 + type) * 64 + (RelativeSquare(color, sq) ^ mirror);
+}
+
+INLINE void AddFeature(int16_t *values, const int index) {
+    for (int i = 0; i < NNUE_HIDDEN; ++i)
+        values[i] += FeatureWeights[index][i];
+}
+
+INLINE void SubFeature(int16_t *values, const int index) {
+    for (int i = 0; i < NNUE_HIDDEN; ++i)
+        values[i] -= FeatureWeights[index][i];
+}
+
+// Recomputes one side of an accumulator from the pieces on the board
+static void RefreshAccumulator(const Position *pos, Accumulator *acc, const Color color) {
+
+    int16_t *values = acc->values[color];
+    const Square king = kingSq(color);
+
+    memcpy(values, FeatureBiases, sizeof(FeatureBiases));
+
+    Bitboard pieces = pieceBB(ALL);
+    while (pieces) {
+        Square sq = PopLsb(&pieces);
+        AddFeature(values, FeatureIndex(color, king, pieceOn(sq), sq));
+    }
+
+    acc->computed[color] = true;
+}
+
+// Brings one side of the accumulator up to date, either by applying the piece
+// changes since the last computed ply, or by a refresh if the king has moved
+static void UpdateAccumulator(const Position *pos, Accumulator *acc, const Color color) {
+
+    if (acc->computed[color]) return;
+
+    Accumulator *prev = acc;
+    while (!prev->computed[color] && !prev->refresh[color])
+        prev--;
+
+    if (!prev->computed[color])
+        return RefreshAccumulator(pos, acc, color);
+
+    // The king hasn't moved since prev, so its square is the current one
+    const Square king = kingSq(color);
+
+    for (Accumulator *next = prev + 1; next <= acc; prev = next++) {
+
+        memcpy(next->values[color], prev->values[color], sizeof(next->values[color]));
+
+        for (int i = 0; i < next->deltaCount; ++i) {
+            Delta *delta = &next->deltas[i];
+            int index = FeatureIndex(color, king, delta->piece, delta->sq);
+            if (delta->add) AddFeature(next->values[color], index);
+            else            SubFeature(next->values[color], index);
+        }
+
+        next->computed[color] = true;
+    }
+}
+
+// Clipped ReLU of both accumulators dotted with the output weights
+#if defined(__AVX2__)
+static int32_t OutputLayer(const int16_t *us, const int16_t *them) {
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa = _mm256_set1_epi16(QA);
+    __m256i sum = _mm256_setzero_si256();
+
+    for (int side = 0; side < 2; ++side) {
+
+        const __m256i *values  = (const __m256i *)(side ? them : us);
+        const __m256i *weights = (const __m256i *)(OutputWeights + side * NNUE_HIDDEN);
+
+        for (int i = 0; i < NNUE_HIDDEN / 16; ++i) {
+            __m256i clipped = _mm256_min_epi16(_mm256_max_epi16(values[i], zero), qa);
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(clipped, weights[i]));
+        }
+    }
+
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_cvtsi128_si32(sum128);
+}
+#elif defined(__SSE4_1__)
+static int32_t OutputLayer(const int16_t *us, const int16_t *them) {
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i qa = _mm_set1_epi16(QA);
+    __m128i sum = _mm_setzero_si128();
+
+    for (int side = 0; side < 2; ++side) {
+
+        const __m128i *values  = (const __m128i *)(side ? them : us);
+        const __m128i *weights = (const __m128i *)(OutputWeights + side * NNUE_HIDDEN);
+
+        for (int i = 0; i < NNUE_HIDDEN / 8; ++i) {
+            __m128i clipped = _mm_min_epi16(_mm_max_epi16(values[i], zero), qa);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(clipped, weights[i]));
+        }
+    }
+
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_cvtsi128_si32(sum);
+}
+#else
+static int32_t OutputLayer(const int16_t *us, const int16_t *them) {
+
+    int32_t sum = 0;
+
+    for (int i = 0; i < NNUE_HIDDEN; ++i)
+        sum += CLAMP(us[i],   0, QA) * OutputWeights[i]
+             + CLAMP(them[i], 0, QA) * OutputWeights[NNUE_HIDDEN + i];
+
+    return sum;
+}
+#endif
+
+// Returns the network evaluation from the side to move's point of view
+int EvalNNUE(const Position *pos) {
+
+    Accumulator *acc = pos->acc;
+
+    UpdateAccumulator(pos, acc, WHITE);
+    UpdateAccumulator(pos, acc, BLACK);
+
+    int32_t output = OutputLayer(acc->values[sideToMove], acc->values[!sideToMove]);
+
+    return (output + OutputBias) * SCALE / (QA * QB);
+}
+
+// Loads a network from file, falling back to the classical eval on failure
+bool LoadNetwork(const char *path) {
+
+    UseNNUE = false;
+
+    if (!strncmp(path, "<empty>", 7) || !*path)
+        return puts("info string Using classical evaluation"), false;
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return printf("info string Could not open network %s, using classical evaluation\n", path), false;
+
+    bool success = fread(FeatureWeights, sizeof(FeatureWeights), 1, file)
+                && fread(FeatureBiases,  sizeof(FeatureBiases),  1, file)
+                && fread(OutputWeights,  sizeof(OutputWeights),  1, file)
+                && fread(&OutputBias,    sizeof(OutputBias),     1, file)
+                && fgetc(file) == EOF;
+
+    fclose(file);
+
+    if (!success)
+        return printf("info string Network %s has the wrong size, using classical evaluation\n", path), false;
+
+    printf("info string Loaded network %s\n", path);
+
+    return UseNNUE = true;
+}
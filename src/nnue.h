@@ -0,0 +1,81 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "board.h"
+#include "types.h"
+
+
+/* Network layout - (HalfKA, 32 king buckets) x 12 x 64 -> 256 x 2 -> 1
+
+   Each side's king square selects one of 32 buckets, with the board mirrored
+   so the king is always on files a-d, and flipped for black. The file is
+   little endian int16 throughout, in order:
+
+   int16 featureWeights[INPUTS][HIDDEN]
+   int16 featureBiases[HIDDEN]
+   int16 outputWeights[2 * HIDDEN]   (side to move first)
+   int16 outputBias
+*/
+
+#define NNUE_BUCKETS 32
+#define NNUE_INPUTS  (NNUE_BUCKETS * 12 * 64)
+#define NNUE_HIDDEN  256
+
+typedef struct Delta {
+    uint8_t piece;
+    uint8_t sq;
+    bool add;
+} Delta;
+
+// One per ply, updated lazily from the closest computed ancestor
+typedef struct Accumulator {
+    _Alignas(64) int16_t values[COLOR_NB][NNUE_HIDDEN];
+    bool computed[COLOR_NB];
+    bool refresh[COLOR_NB];
+    int deltaCount;
+    Delta deltas[5]; // Capturing with promotion records 5 changes
+} Accumulator;
+
+
+extern bool UseNNUE;
+
+
+bool LoadNetwork(const char *path);
+int EvalNNUE(const Position *pos);
+
+// Marks an accumulator as needing a full refresh for both sides
+INLINE void ResetAccumulator(Accumulator *acc) {
+    acc->computed[WHITE] = acc->computed[BLACK] = false;
+    acc->refresh[WHITE]  = acc->refresh[BLACK]  = true;
+    acc->deltaCount = 0;
+}
+
+// Starts the accumulator of the next ply
+INLINE void PushAccumulator(Position *pos) {
+    Accumulator *acc = ++pos->acc;
+    acc->computed[WHITE] = acc->computed[BLACK] = false;
+    acc->refresh[WHITE]  = acc->refresh[BLACK]  = false;
+    acc->deltaCount = 0;
+}
+
+// Records a piece added to or removed from a square
+INLINE void RecordDelta(Position *pos, const Piece piece, const Square sq, const bool add) {
+    pos->acc->deltas[pos->acc->deltaCount++] = (Delta) { piece, sq, add };
+}
@@ -0,0 +1,190 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__)
+    #define _GNU_SOURCE
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "numa.h"
+
+
+bool NumaBind = false;
+int PinPolicy = PIN_NONE;
+int NodeCount = 1;
+
+#if defined(__linux__)
+typedef struct LogicalCPU {
+    int id, package, core, smt;
+} LogicalCPU;
+
+static cpu_set_t NodeCPUs[MAX_NODES];
+static int PinOrder[CPU_SETSIZE];
+static int PinCount;
+
+
+// Parses a sysfs cpu list like "0-15,32-47" into a cpu set
+static void ParseCPUList(char *list, cpu_set_t *cpus) {
+
+    CPU_ZERO(cpus);
+
+    for (char *range = strtok(list, ",\n"); range; range = strtok(NULL, ",\n")) {
+        int first, last;
+        int count = sscanf(range, "%d-%d", &first, &last);
+        if (count == 1) last = first;
+        if (count < 1) continue;
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+            CPU_SET(cpu, cpus);
+    }
+}
+
+// Reads which cpus belong to each NUMA node
+static void InitNodes() {
+
+    char path[64], list[4096];
+    int count = 0;
+
+    for (int node = 0; node < 1024 && count < MAX_NODES; ++node) {
+
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+
+        FILE *file = fopen(path, "r");
+        if (!file) continue;
+
+        bool success = fgets(list, sizeof(list), file);
+        fclose(file);
+
+        // Skip memory-only nodes
+        if (!success) continue;
+        ParseCPUList(list, &NodeCPUs[count]);
+        if (CPU_COUNT(&NodeCPUs[count])) count++;
+    }
+
+    NodeCount = MAX(1, count);
+
+    // No NUMA information, allow all cpus
+    if (!count)
+        sched_getaffinity(0, sizeof(cpu_set_t), &NodeCPUs[0]);
+}
+
+// Reads a single number from a sysfs topology file
+static int ReadTopology(int cpu, const char *name, int fallback) {
+
+    char path[128];
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+
+    FILE *file = fopen(path, "r");
+    if (!file) return fallback;
+
+    int value;
+    if (fscanf(file, "%d", &value) != 1)
+        value = fallback;
+
+    fclose(file);
+    return value;
+}
+
+static int ComparePolicy;
+
+// Sort keys for each policy, in order of importance
+static int CompareCPUs(const void *a, const void *b) {
+
+    const LogicalCPU *x = a, *y = b;
+
+    #define Compare(field) if (x->field != y->field) return x->field - y->field
+
+    switch (ComparePolicy) {
+        case PIN_COMPACT: Compare(package); Compare(core); Compare(smt); break;
+        case PIN_SCATTER: Compare(smt); Compare(core); Compare(package); break;
+        case PIN_SKIPSMT: Compare(smt); Compare(package); Compare(core); break;
+    }
+
+    return x->id - y->id;
+}
+
+// Orders the cpus we are allowed to run on according to the pinning policy
+static void InitPinOrder() {
+
+    static LogicalCPU cpus[CPU_SETSIZE];
+    cpu_set_t allowed;
+    int count = 0;
+
+    sched_getaffinity(0, sizeof(cpu_set_t), &allowed);
+
+    for (int id = 0; id < CPU_SETSIZE; ++id) {
+
+        if (!CPU_ISSET(id, &allowed)) continue;
+
+        LogicalCPU *cpu = &cpus[count++];
+        cpu->id      = id;
+        cpu->package = ReadTopology(id, "physical_package_id", 0);
+        cpu->core    = ReadTopology(id, "core_id", id);
+        cpu->smt     = 0;
+
+        // Number the SMT siblings of each core
+        for (LogicalCPU *other = cpus; other < cpu; ++other)
+            cpu->smt += other->package == cpu->package && other->core == cpu->core;
+    }
+
+    ComparePolicy = PinPolicy;
+    qsort(cpus, count, sizeof(LogicalCPU), CompareCPUs);
+
+    for (int i = 0; i < count; ++i)
+        PinOrder[i] = cpus[i].id;
+
+    PinCount = MAX(1, count);
+}
+#endif
+
+// Reads the cpu layout needed for binding threads
+void InitTopology() {
+#if defined(__linux__)
+    InitNodes();
+    if (PinPolicy != PIN_NONE)
+        InitPinOrder();
+#endif
+}
+
+// Binds the calling thread to a single cpu if pinning, or else to the
+// cpus of a node, spreading threads evenly over the nodes
+void BindThread(int index) {
+#if defined(__linux__)
+    cpu_set_t cpus;
+
+    if (PinPolicy != PIN_NONE) {
+        CPU_ZERO(&cpus);
+        CPU_SET(PinOrder[index % PinCount], &cpus);
+    } else
+        cpus = NodeCPUs[index % NodeCount];
+
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+#else
+    (void)index;
+#endif
+}
+
+int ParsePinPolicy(const char *str) {
+    return !strncmp(str, "compact", 7) ? PIN_COMPACT
+         : !strncmp(str, "scatter", 7) ? PIN_SCATTER
+         : !strncmp(str, "skipsmt", 7) ? PIN_SKIPSMT
+                                       : PIN_NONE;
+}
@@ -0,0 +1,43 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "types.h"
+
+
+#define MAX_NODES 64
+
+
+// Orders in which threads are pinned to logical cpus
+enum PinPolicy {
+    PIN_NONE,    // Let the OS schedule threads freely
+    PIN_COMPACT, // Fill every SMT sibling of a core before moving on to the next
+    PIN_SCATTER, // Spread threads over sockets and cores before using SMT siblings
+    PIN_SKIPSMT  // Fill physical cores socket by socket, SMT siblings only when out of cores
+};
+
+
+extern bool NumaBind;
+extern int PinPolicy;
+extern int NodeCount;
+
+
+void InitTopology();
+void BindThread(int index);
+int ParsePinPolicy(const char *str);
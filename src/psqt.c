@@ -18,13 +18,19 @@
 
 #include "board.h"
 #include "evaluate.h"
+#include "gentables.h"
 #include "psqt.h"
 
 
 extern const int PieceTypeValue[TYPE_NB];
 
 
+#ifdef PREGEN
+    #define TABLES_PSQT
+    #include "tables.h"
+#else
 int PSQT[PIECE_NB][64];
+#endif
 
 // Black's point of view - easier to read as it's not upside down
 const int PieceSqValue[6][64] = {
@@ -84,6 +90,7 @@ const int PieceSqValue[6][64] = {
       S( 37,-41), S( 89, -1), S( 64, 30), S(-39, 43), S( 33, 17), S(-18, 50), S( 66,  3), S( 36,-41) },
 };
 
+#ifndef PREGEN
 // Initialize the piece square tables with piece values included
 CONSTR(1) InitPSQT() {
     for (PieceType pt = PAWN; pt <= KING; ++pt)
@@ -93,3 +100,8 @@ CONSTR(1) InitPSQT() {
             PSQT[MakePiece(BLACK, pt)][             sq ] = -value;
         }
 }
+#endif
+
+void PrintPSQTTables() {
+    PrintTable("const int PSQT[PIECE_NB][64]", PSQT, sizeof(int), true, 2, PIECE_NB, 64);
+}
@@ -21,4 +21,4 @@
 #include "types.h"
 
 
-extern int PSQT[PIECE_NB][64];
+extern TABLE int PSQT[PIECE_NB][64];
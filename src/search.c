@@ -24,6 +24,7 @@
 #include "bitboard.h"
 #include "board.h"
 #include "evaluate.h"
+#include "gentables.h"
 #include "history.h"
 #include "makemove.h"
 #include "move.h"
@@ -40,6 +41,17 @@ SearchLimits Limits = { .multiPV = 1 };
 atomic_bool ABORT_SIGNAL;
 atomic_bool SEARCH_STOPPED = true;
 
+// Counts a search decision in STATS builds
+#ifdef STATS
+    #define Stat(field) (thread->stats.field++)
+#else
+    #define Stat(field) ((void)0)
+#endif
+
+#ifdef PREGEN
+    #define TABLES_SEARCH
+    #include "tables.h"
+#else
 static int Reductions[2][32][32];
 
 
@@ -50,6 +62,11 @@ CONSTR(1) InitReductions() {
             Reductions[0][depth][moves] = 0.33 + log(depth) * log(moves) / 3.20, // capture
             Reductions[1][depth][moves] = 1.65 + log(depth) * log(moves) / 2.80; // quiet
 }
+#endif
+
+void PrintSearchTables() {
+    PrintTable("static const int Reductions[2][32][32]", Reductions, sizeof(int), true, 3, 2, 32, 32);
+}
 
 // Checks whether a move was already searched in multi-pv mode
 static bool AlreadySearchedMultiPV(Thread *thread, Move move) {
@@ -87,13 +104,17 @@ static int Quiescence(Thread *thread, Stack *ss, int alpha, const int beta) {
 
     // Probe transposition table
     bool ttHit;
-    TTEntry *tte = ProbeTT(pos->key, &ttHit);
+    TTEntry ttData;
+    TTEntry *tte = ProbeTT(pos->key, &ttData, &ttHit);
 
-    Move ttMove = ttHit ? tte->move : NOMOVE;
-    int ttScore = ttHit ? ScoreFromTT(tte->score, ss->ply) : NOSCORE;
-    int ttEval  = ttHit ? tte->eval : NOSCORE;
-    // Depth ttDepth = tte->depth;
-    int ttBound = Bound(tte);
+    thread->counters.ttProbes++;
+    thread->counters.ttHits += ttHit;
+
+    Move ttMove = ttHit ? ttData.move : NOMOVE;
+    int ttScore = ttHit ? ScoreFromTT(ttData.score, ss->ply) : NOSCORE;
+    int ttEval  = ttHit ? ttData.eval : NOSCORE;
+    // Depth ttDepth = ttData.depth;
+    int ttBound = Bound(&ttData);
 
     if (ttMove && !MoveIsPseudoLegal(pos, ttMove))
         ttHit = false, ttMove = NOMOVE, ttScore = NOSCORE, ttEval = NOSCORE;
@@ -105,7 +126,7 @@ static int Quiescence(Thread *thread, Stack *ss, int alpha, const int beta) {
     // Do a static evaluation for pruning considerations
     eval = history(-1).move == NOMOVE ? -(ss-1)->staticEval + 2 * Tempo
          : ttEval != NOSCORE          ? ttEval
-                                      : EvalPosition(pos, thread->pawnCache);
+                                      : CachedEval(pos, &thread->evalCache, &thread->pawnCache);
 
     // If we are at max depth, return static eval
     if (ss->ply >= MAX_PLY)
@@ -127,7 +148,7 @@ static int Quiescence(Thread *thread, Stack *ss, int alpha, const int beta) {
 moveloop:
 
     if (!inCheck) InitNoisyMP(&mp, thread, ss, ttMove);
-    else          InitNormalMP(&mp, thread, ss, 0, ttMove, NOMOVE, NOMOVE);
+    else          InitEvasionMP(&mp, thread, ss, 0, ttMove, NOMOVE, NOMOVE);
 
     // Move loop
     Move bestMove = NOMOVE;
@@ -220,7 +241,7 @@ static int AlphaBeta(Thread *thread, Stack *ss, int alpha, int beta, Depth depth
 
         // Max depth reached
         if (ss->ply >= MAX_PLY)
-            return EvalPosition(pos, thread->pawnCache);
+            return CachedEval(pos, &thread->evalCache, &thread->pawnCache);
 
         // Mate distance pruning
         alpha = MAX(alpha, -MATE + ss->ply);
@@ -235,13 +256,17 @@ static int AlphaBeta(Thread *thread, Stack *ss, int alpha, int beta, Depth depth
 
     // Probe transposition table
     bool ttHit;
-    TTEntry *tte = ProbeTT(pos->key, &ttHit);
+    TTEntry ttData;
+    TTEntry *tte = ProbeTT(pos->key, &ttData, &ttHit);
+
+    thread->counters.ttProbes++;
+    thread->counters.ttHits += ttHit;
 
-    Move ttMove = ttHit ? tte->move : NOMOVE;
-    int ttScore = ttHit ? ScoreFromTT(tte->score, ss->ply) : NOSCORE;
-    int ttEval = ttHit ? tte->eval : NOSCORE;
-    Depth ttDepth = tte->depth;
-    int ttBound = Bound(tte);
+    Move ttMove = ttHit ? ttData.move : NOMOVE;
+    int ttScore = ttHit ? ScoreFromTT(ttData.score, ss->ply) : NOSCORE;
+    int ttEval = ttHit ? ttData.eval : NOSCORE;
+    Depth ttDepth = ttData.depth;
+    int ttBound = Bound(&ttData);
 
     if (ttMove && (!MoveIsPseudoLegal(pos, ttMove) || ttMove == ss->excluded))
         ttHit = false, ttMove = NOMOVE, ttScore = NOSCORE, ttEval = NOSCORE;
@@ -255,17 +280,17 @@ static int AlphaBeta(Thread *thread, Stack *ss, int alpha, int beta, Depth depth
             PawnHistoryUpdate(ttMove, Bonus(depth));
         }
 
-        return ttScore;
+        return Stat(ttCutoffs), ttScore;
     }
 
     int bestScore = -INFINITE;
     int maxScore  =  INFINITE;
 
-    // Probe syzygy TBs
+    // Probe syzygy TBs, unless too shallow to be worth the I/O
     int tbScore, bound;
-    if (!ss->excluded && ProbeWDL(pos, &tbScore, &bound, ss->ply)) {
+    if (!ss->excluded && depth >= SyzygyProbeDepth && ProbeWDL(thread, &tbScore, &bound, ss->ply)) {
 
-        thread->tbhits++;
+        thread->counters.tbhits++;
 
         // Draw scores are exact, while wins are lower bounds and losses upper bounds (mate scores are better/worse)
         if (bound == BOUND_EXACT || (bound == BOUND_LOWER ? tbScore >= beta : tbScore <= alpha)) {
@@ -289,7 +314,7 @@ static int AlphaBeta(Thread *thread, Stack *ss, int alpha, int beta, Depth depth
     int eval = ss->staticEval =  inCheck           ? NOSCORE
                                : lastMoveNullMove  ? -(ss-1)->staticEval + 2 * Tempo
                                : ttEval != NOSCORE ? ttEval
-                                                   : EvalPosition(pos, thread->pawnCache);
+                                                   : CachedEval(pos, &thread->evalCache, &thread->pawnCache);
 
     // Use ttScore as eval if it is more informative
     if (ttScore != NOSCORE && TTScoreIsMoreInformative(ttBound, ttScore, eval))
@@ -309,12 +334,14 @@ static int AlphaBeta(Thread *thread, Stack *ss, int alpha, int beta, Depth depth
     if (inCheck || pvNode || !thread->doPruning || ss->excluded || abs(beta) >= TBWIN_IN_MAX || history(-1).move == NOMOVE)
         goto move_loop;
 
+    Stat(pruningNodes);
+
     // Reverse Futility Pruning
     if (   depth < 7
         && eval >= beta
         && eval - 92 * (depth - improving) - (ss-1)->histScore / 128 >= beta
         && (!ttMove || GetHistory(thread, ss, ttMove) > 8650))
-        return eval;
+        return Stat(rfpCutoffs), eval;
 
     // Null Move Pruning
     if (   eval >= beta
@@ -325,6 +352,8 @@ static int AlphaBeta(Thread *thread, Stack *ss, int alpha, int beta, Depth depth
 
         Depth reduction = 3 + depth / 4 + MIN(3, (eval - beta) / 256);
 
+        Stat(nullMoveTries);
+
         ss->continuation = &thread->continuation[0][0][EMPTY][0];
 
         MakeNullMove(pos);
@@ -334,7 +363,7 @@ static int AlphaBeta(Thread *thread, Stack *ss, int alpha, int beta, Depth depth
         // Cutoff
         if (score >= beta)
             // Don't return unproven terminal win scores
-            return score >= TBWIN_IN_MAX ? beta : score;
+            return Stat(nullMoveCutoffs), score >= TBWIN_IN_MAX ? beta : score;
     }
 
     int probCutBeta = beta + 200;
@@ -343,6 +372,8 @@ static int AlphaBeta(Thread *thread, Stack *ss, int alpha, int beta, Depth depth
     if (   depth >= 5
         && (!ttHit || ttBound == BOUND_LOWER || ttScore >= probCutBeta)) {
 
+        Stat(probCutTries);
+
         InitProbcutMP(&mp, thread, ss, probCutBeta - ss->staticEval);
 
         Move move;
@@ -365,13 +396,14 @@ static int AlphaBeta(Thread *thread, Stack *ss, int alpha, int beta, Depth depth
 
             // Cut if the reduced depth search beats the threshold
             if (score >= probCutBeta)
-                return score - 160;
+                return Stat(probCutCutoffs), score - 160;
         }
     }
 
 move_loop:
 
-    InitNormalMP(&mp, thread, ss, depth, ttMove, ss->killers[0], ss->killers[1]);
+    if (inCheck) InitEvasionMP(&mp, thread, ss, depth, ttMove, ss->killers[0], ss->killers[1]);
+    else         InitNormalMP (&mp, thread, ss, depth, ttMove, ss->killers[0], ss->killers[1]);
 
     Move quiets[32];
     Move noisys[32];
@@ -406,12 +438,16 @@ move_loop:
                 mp.onlyNoisy = true;
 
             // History pruning
-            if (lmrDepth < 3 && ss->histScore < -1024 * depth)
+            if (lmrDepth < 3 && ss->histScore < -1024 * depth) {
+                Stat(historyPruned);
                 continue;
+            }
 
             // SEE pruning
-            if (lmrDepth < 7 && !SEE(pos, move, quiet ? -53 * depth : -73 * depth))
+            if (lmrDepth < 7 && !SEE(pos, move, quiet ? -53 * depth : -73 * depth)) {
+                Stat(seePruned);
                 continue;
+            }
         }
 
         // Make the move, skipping to the next if illegal
@@ -437,6 +473,8 @@ move_loop:
             // ttMove has been made to check legality
             TakeMove(pos);
 
+            Stat(singularTries);
+
             // Search to reduced depth with a zero window a bit lower than ttScore
             int singularBeta = ttScore - depth * 2;
             ss->excluded = move;
@@ -448,12 +486,13 @@ move_loop:
                 extension = 1;
                 if (!pvNode && score < singularBeta - 6 && ss->doubleExtensions <= 5)
                     extension = 2;
+                Stat(singularExtensions[extension - 1]);
             // MultiCut - ttMove as well as at least one other move seem good enough to beat beta
             } else if (singularBeta >= beta)
-                return singularBeta;
+                return Stat(multiCuts), singularBeta;
             // Negative extension - not singular but likely still good enough to beat beta
             else if (ttScore >= beta)
-                extension = -1;
+                extension = -1, Stat(negativeExtensions);
 
             // Replay ttMove
             MakeMove(pos, move);
@@ -493,10 +532,14 @@ skip_extensions:
             // Depth after reductions, avoiding going straight to quiescence as well as extending
             Depth lmrDepth = CLAMP(newDepth - r, 1, newDepth);
 
+            Stat(lmrSearches);
+
             score = -AlphaBeta(thread, ss+1, -alpha-1, -alpha, lmrDepth, true);
 
             // Re-search with the same window at full depth if the reduced search failed high
             if (score > alpha && lmrDepth < newDepth) {
+
+                Stat(lmrResearches);
                 bool deeper = score > bestScore + 23 + 13 * (newDepth - lmrDepth);
 
                 newDepth += deeper;
@@ -538,6 +581,8 @@ skip_extensions:
 
                 // If score beats beta we have a cutoff
                 if (score >= beta) {
+                    Stat(betaCutoffs);
+                    if (moveCount == 1) Stat(firstMoveCutoffs);
                     UpdateHistory(thread, ss, bestMove, depth, quiets, quietCount, noisys, noisyCount);
                     break;
                 }
@@ -658,6 +703,7 @@ static void *IterativeDeepening(void *voidThread) {
         if (!mainThread) continue;
 
         // Print thinking info
+        thread->seldepth = SelDepth(pos);
         PrintThinking(thread, -INFINITE, INFINITE);
 
         // Stop searching after finding a short enough mate
@@ -27,7 +27,7 @@ typedef struct {
     int time, inc, movestogo, movetime, depth;
     int optimalUsage, maxUsage;
     int mate;
-    bool timelimit, infinite;
+    bool timelimit, infinite, quiet;
     Move searchmoves[64];
     int multiPV;
 } SearchLimits;
@@ -39,3 +39,11 @@ extern atomic_bool SEARCH_STOPPED;
 
 
 void *SearchPosition(void *pos);
+
+// Deepest ply reached this iteration, as the keys are cleared after each one
+INLINE Depth SelDepth(const Position *pos) {
+    Depth seldepth = 128;
+    for (; seldepth > 0; --seldepth)
+        if (history(seldepth-1).key != 0) break;
+    return seldepth;
+}
@@ -0,0 +1,179 @@
+/*
+  Weiss is a UCI compliant chess engine.
+  Copyright (C) 2023 Terje Kirstihagen
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+
+#include "onlinesyzygy/onlinesyzygy.h"
+#include "bitboard.h"
+#include "move.h"
+#include "syzygy.h"
+#include "time.h"
+#include "transposition.h"
+
+
+int SyzygyCacheMB = SYZYGY_CACHE_DEFAULT;
+int SyzygyProbeDepth = 0;
+int SyzygyProbeLimit = 7;
+
+// WDL results shared by all threads. Each entry is a single 64-bit word
+// holding the upper bits of the key and the result + 1 in the low byte, so
+// concurrent reads and writes can't tear it and an empty entry is zero
+static _Atomic uint64_t *Cache;
+static uint64_t CacheMask;
+
+#define CACHE_RESULT_MASK 0xFFull
+
+
+// Allocates the WDL cache using the largest power of two number of entries
+// that fits, or none if no tablebases are loaded. Also clears it
+void InitSyzygyCache() {
+
+    free(Cache);
+    Cache = NULL;
+
+    if (!TB_LARGEST || !SyzygyCacheMB) return;
+
+    uint64_t entries = 1;
+    while (2 * entries * sizeof(*Cache) <= (uint64_t)SyzygyCacheMB * 1024 * 1024)
+        entries *= 2;
+
+    Cache = calloc(entries, sizeof(*Cache));
+    CacheMask = entries - 1;
+
+    if (!Cache) {
+        printf("Failed to allocate %dMB for syzygy cache.\n", SyzygyCacheMB);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Loads the tablebases, and clears the cache as results may differ
+void InitSyzygy(const char *path) {
+    tb_init(path);
+    InitSyzygyCache();
+}
+
+// Probe local Syzygy files using Pyrrhic to get score, unless the result is cached
+bool ProbeWDL(Thread *thread, int *score, int *bound, int ply) {
+
+    const Position *pos = &thread->pos;
+
+    // Don't probe at root, when castling is possible, or when 50 move rule
+    // was not reset by the last move. Finally, there is obviously no point
+    // if there are more pieces than we have TBs for, or are allowed to probe.
+    if (  !ply
+        || pos->castlingRights
+        || pos->rule50
+        || PopCount(pieceBB(ALL)) > MIN(TB_LARGEST, SyzygyProbeLimit))
+        return false;
+
+    _Atomic uint64_t *slot = Cache ? &Cache[pos->key & CacheMask] : NULL;
+    uint64_t entry = slot ? loadRelaxed(*slot) : 0;
+    unsigned result;
+
+    thread->counters.tbCacheProbes += slot != NULL;
+
+    if (entry && !((entry ^ pos->key) & ~CACHE_RESULT_MASK)) {
+        thread->counters.tbCacheHits++;
+        result = (entry & CACHE_RESULT_MASK) - 1;
+
+    } else {
+        // Call Pyrrhic, timing it as reading the files can stall the thread
+        uint64_t start = NowNs();
+
+        result = tb_probe_wdl(
+            colorBB(WHITE),  colorBB(BLACK),
+            pieceBB(KING),   pieceBB(QUEEN),
+            pieceBB(ROOK),   pieceBB(BISHOP),
+            pieceBB(KNIGHT), pieceBB(PAWN),
+            pos->epSquare, !sideToMove);
+
+        thread->counters.tbProbes++;
+        thread->counters.tbProbeNs += NowNs() - start;
+
+        // Probe failed
+        if (result == TB_RESULT_FAILED)
+            return false;
+
+        if (slot)
+            atomic_store_explicit(slot, (pos->key & ~CACHE_RESULT_MASK) | (result + 1), memory_order_relaxed);
+    }
+
+    *score = TBScore(result, ply);
+
+    *bound = result == TB_WIN  ? BOUND_LOWER
+           : result == TB_LOSS ? BOUND_UPPER
+                               : BOUND_EXACT;
+
+    return true;
+}
+
+// Probe local Syzygy files using Pyrrhic to get an optimal move
+static bool ProbeRoot(const Position *pos, Move *move, unsigned *wdl, unsigned *dtz) {
+
+    // Call Pyrrhic
+    unsigned result = tb_probe_root(
+        colorBB(WHITE),  colorBB(BLACK),
+        pieceBB(KING),   pieceBB(QUEEN),
+        pieceBB(ROOK),   pieceBB(BISHOP),
+        pieceBB(KNIGHT), pieceBB(PAWN),
+        pos->rule50, pos->epSquare, !sideToMove);
+
+    // Probe failed
+    if (   result == TB_RESULT_FAILED
+        || result == TB_RESULT_CHECKMATE
+        || result == TB_RESULT_STALEMATE)
+        return false;
+
+    // Extract information
+    unsigned from  = TB_GET_FROM(result);
+    unsigned to    = TB_GET_TO(result);
+    unsigned promo = TB_GET_PROMOTES(result);
+
+    *move = MOVE(from, to, 0, 0, promo ? 6 - promo : 0, 0);
+    *wdl = TB_GET_WDL(result);
+    *dtz = TB_GET_DTZ(result) - 1;
+
+    return true;
+}
+
+// Get optimal move from Syzygy tablebases
+bool SyzygyMove(const Position *pos) {
+
+    Move move;
+    unsigned wdl, dtz;
+    int pieces = PopCount(pieceBB(ALL));
+
+    // Probe local or online Syzygy if possible
+    bool success =
+          pos->castlingRights         ? false
+        : pieces <= TB_LARGEST        ? ProbeRoot(pos, &move, &wdl, &dtz)
+        : OnlineSyzygy && pieces <= 7 ? QueryRoot(pos, &move, &wdl, &dtz)
+                                      : false;
+
+    if (!success) return false;
+
+    // Print thinking info
+    printf("info depth %d seldepth %d score cp %d time 0 nodes 0 nps 0 tbhits 1 pv %s\n",
+           MAX_PLY, MAX_PLY, TBScore(wdl, dtz), MoveToStr(move));
+    fflush(stdout);
+
+    // Set move to be printed as conclusion
+    Threads->rootMoves[0].move = move;
+
+    return true;
+}
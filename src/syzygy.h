@@ -18,106 +18,27 @@
 
 #pragma once
 
-#include "onlinesyzygy/onlinesyzygy.h"
 #include "pyrrhic/tbprobe.h"
-#include "bitboard.h"
-#include "move.h"
-#include "transposition.h"
+#include "threads.h"
 #include "types.h"
 
 
-// Converts a tbresult into a score
-static int TBScore(const unsigned result, const int distance) {
-    return result == TB_WIN  ?  TBWIN - distance
-         : result == TB_LOSS ? -TBWIN + distance
-                             :  0;
-}
-
-// Probe local Syzygy files using Pyrrhic to get score
-static bool ProbeWDL(const Position *pos, int *score, int *bound, int ply) {
-
-    // Don't probe at root, when castling is possible, or when 50 move rule
-    // was not reset by the last move. Finally, there is obviously no point
-    // if there are more pieces than we have TBs for.
-    if (  !ply
-        || pos->castlingRights
-        || pos->rule50
-        || PopCount(pieceBB(ALL)) > TB_LARGEST)
-        return false;
-
-    // Call Pyrrhic
-    unsigned result = tb_probe_wdl(
-        colorBB(WHITE),  colorBB(BLACK),
-        pieceBB(KING),   pieceBB(QUEEN),
-        pieceBB(ROOK),   pieceBB(BISHOP),
-        pieceBB(KNIGHT), pieceBB(PAWN),
-        pos->epSquare, !sideToMove);
-
-    // Probe failed
-    if (result == TB_RESULT_FAILED)
-        return false;
-
-    *score = TBScore(result, ply);
-
-    *bound = result == TB_WIN  ? BOUND_LOWER
-           : result == TB_LOSS ? BOUND_UPPER
-                               : BOUND_EXACT;
-
-    return true;
-}
+#define SYZYGY_CACHE_DEFAULT 16
 
-// Probe local Syzygy files using Pyrrhic to get an optimal move
-static bool ProbeRoot(const Position *pos, Move *move, unsigned *wdl, unsigned *dtz) {
 
-    // Call Pyrrhic
-    unsigned result = tb_probe_root(
-        colorBB(WHITE),  colorBB(BLACK),
-        pieceBB(KING),   pieceBB(QUEEN),
-        pieceBB(ROOK),   pieceBB(BISHOP),
-        pieceBB(KNIGHT), pieceBB(PAWN),
-        pos->rule50, pos->epSquare, !sideToMove);
+extern int SyzygyCacheMB;
+extern int SyzygyProbeDepth;
+extern int SyzygyProbeLimit;
 
-    // Probe failed
-    if (   result == TB_RESULT_FAILED
-        || result == TB_RESULT_CHECKMATE
-        || result == TB_RESULT_STALEMATE)
-        return false;
 
-    // Extract information
-    unsigned from  = TB_GET_FROM(result);
-    unsigned to    = TB_GET_TO(result);
-    unsigned promo = TB_GET_PROMOTES(result);
-
-    *move = MOVE(from, to, 0, 0, promo ? 6 - promo : 0, 0);
-    *wdl = TB_GET_WDL(result);
-    *dtz = TB_GET_DTZ(result) - 1;
-
-    return true;
+// Converts a tbresult into a score
+INLINE int TBScore(const unsigned result, const int distance) {
+    return result == TB_WIN  ?  TBWIN - distance
+         : result == TB_LOSS ? -TBWIN + distance
+                             :  0;
 }
 
-// Get optimal move from Syzygy tablebases
-static bool SyzygyMove(const Position *pos) {
-
-    Move move;
-    unsigned wdl, dtz;
-    int pieces = PopCount(pieceBB(ALL));
-
-    // Probe local or online Syzygy if possible
-    bool success =
-          pos->castlingRights         ? false
-        : pieces <= TB_LARGEST        ? ProbeRoot(pos, &move, &wdl, &dtz)
-        : OnlineSyzygy && pieces <= 7 ? QueryRoot(pos, &move, &wdl, &dtz)
-                                      : false;
-
-    if (!success) return false;
-
-    // Print thinking info
-    printf("info depth %d seldepth %d score cp %d time 0 nodes 0 nps 0 tbhits 1 pv %s\n",
-           MAX_PLY, MAX_PLY, TBScore(wdl, dtz), MoveToStr(move));
-    fflush(stdout);
-
-    // Set move to be printed as conclusion
-    Threads->rootMoves[0].move = move;
-
-    return true;
-}
+void InitSyzygy(const char *path);
+void InitSyzygyCache();
+bool ProbeWDL(Thread *thread, int *score, int *bound, int ply);
+bool SyzygyMove(const Position *pos);
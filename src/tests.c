@@ -16,10 +16,16 @@
   along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__linux__)
+    #include <unistd.h>
+#endif
+
 #include "board.h"
+#include "cpu.h"
 #include "evaluate.h"
 #include "makemove.h"
 #include "move.h"
@@ -29,6 +35,7 @@
 #include "tests.h"
 #include "time.h"
 #include "transposition.h"
+#include "uci.h"
 
 
 /* Benchmark heavily inspired by Ethereal */
@@ -91,14 +98,142 @@ typedef struct BenchResult {
     uint64_t nodes;
     int score;
     Move best;
+    Depth depth, seldepth;
+    int hashFull;
+    uint64_t ttProbes, ttHits;
 } BenchResult;
 
+typedef struct BenchTotals {
+    TimePoint elapsed;
+    uint64_t nodes;
+    uint64_t ttProbes, ttHits;
+    uint64_t pawnHits, pawnMisses;
+    uint64_t evalHits, evalMisses;
+    double startup, pooled, spawned;
+} BenchTotals;
+
+static void *NoJob(void *arg) {
+    return arg;
+}
+
+// Compares the per-search cost of waking the thread pool to spawning new threads
+static void ThreadDispatchLatency(double *pooled, double *spawned) {
+
+    const int rounds = 1000;
+    const int count = Threads->count;
+    pthread_t pthreads[count];
+
+    TimePoint start = Now();
+    for (int r = 0; r < rounds; ++r)
+        RunWithAllThreads(NoJob);
+    *pooled = 1000.0 * TimeSince(start) / rounds;
+
+    start = Now();
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < count; ++i)
+            pthread_create(&pthreads[i], NULL, NoJob, NULL);
+        for (int i = 0; i < count; ++i)
+            pthread_join(pthreads[i], NULL);
+    }
+    *spawned = 1000.0 * TimeSince(start) / rounds;
+}
+
+// Searches a position with the current limits, returning the time used
+static TimePoint BenchSearch(Position *pos, const char *fen) {
+    ParseFen(fen, pos);
+    ABORT_SIGNAL = false;
+    Limits.start = Now();
+    SearchPosition(pos);
+    return TimeSince(Limits.start);
+}
+
+// Compile time options worth telling apart when comparing bench results
+static const char *BuildFlags[] = {
+#ifdef USE_PEXT
+    "pext",
+#endif
+#ifdef __POPCNT__
+    "popcnt",
+#endif
+#ifdef __AVX2__
+    "avx2",
+#endif
+#ifdef DISPATCH
+    "dispatch",
+#endif
+#ifdef PREGEN
+    "pregen",
+#endif
+#ifdef PGO
+    "pgo",
+#endif
+#ifdef UNPADDED
+    "unpadded",
+#endif
+#ifdef DEV
+    "dev",
+#endif
+#ifdef TUNE
+    "tune",
+#endif
+#ifndef NDEBUG
+    "debug",
+#endif
+    NULL
+};
+
+// Prints the results as a json object for tracking them across builds
+static void PrintBenchJSON(const BenchResult results[], int count, const BenchTotals *t) {
+
+    printf("{\n  \"build\": {\n    \"flags\": [");
+    for (int i = 0; BuildFlags[i]; ++i)
+        printf("%s\"%s\"", i ? ", " : "", BuildFlags[i]);
+    printf("],\n");
+    printf("    \"compiler\": \"%s\",\n", __VERSION__);
+    printf("    \"cpu\": \"%s\",\n", CPUBrand());
+    printf("    \"path\": \"%s\"\n  },\n", CPUPath());
+
+    printf("  \"settings\": { \"depth\": %d, \"threads\": %d, \"hash\": %" PRIu64 ", \"pawnhash\": %d },\n",
+           Limits.depth, Threads->count, (uint64_t)TT.requestedMB, PawnCacheMB);
+    printf("  \"startup_ms\": %.2f,\n", t->startup);
+    printf("  \"dispatch_us\": { \"pooled\": %.1f, \"spawned\": %.1f },\n", t->pooled, t->spawned);
+
+    printf("  \"positions\": [\n");
+    for (int i = 0; i < count; ++i) {
+        const BenchResult *r = &results[i];
+        printf("    { \"fen\": \"%s\", \"depth\": %d, \"seldepth\": %d, \"score\": %d, \"best\": \"%s\", "
+               "\"nodes\": %" PRIu64 ", \"time_ms\": %" PRIi64 ", \"nps\": %d, \"tt_hit_rate\": %.4f, \"hashfull\": %d }%s\n",
+               BenchmarkFENs[i], r->depth, r->seldepth, r->score, MoveToStr(r->best),
+               r->nodes, r->elapsed, (int)(1000.0 * r->nodes / (r->elapsed + 1)),
+               (double)r->ttHits / (r->ttProbes + 1), r->hashFull, i < count - 1 ? "," : "");
+    }
+    printf("  ],\n");
+
+    printf("  \"total\": { \"nodes\": %" PRIu64 ", \"time_ms\": %" PRIi64 ", \"nps\": %d, "
+           "\"tt_hit_rate\": %.4f, \"pawn_hit_rate\": %.4f, \"eval_hit_rate\": %.4f }\n}\n",
+           t->nodes, t->elapsed, (int)(1000.0 * t->nodes / t->elapsed),
+           (double)t->ttHits / (t->ttProbes + 1),
+           (double)t->pawnHits / (t->pawnHits + t->pawnMisses + 1),
+           (double)t->evalHits / (t->evalHits + t->evalMisses + 1));
+}
+
 void Benchmark(int argc, char **argv) {
 
-    // Default depth 16, 1 thread, and 32MB hash
+    // Cpu time spent so far is process startup, mostly table initialization
+    BenchTotals t = { .startup = 1000.0 * clock() / CLOCKS_PER_SEC, .elapsed = 1 }; // Avoid possible div/0
+
+    // Json output if --json is given anywhere in the arguments
+    bool json = false;
+    for (int i = 2; i < argc; ++i)
+        if (!strcmp(argv[i], "--json"))
+            json = true, memmove(&argv[i], &argv[i+1], (argc - i) * sizeof(char *)), argc--, i--;
+
+    // Default depth 16, 1 thread, 32MB hash and 2MB pawn hash per thread
     Limits.depth     = argc > 2 ? atoi(argv[2]) : 16;
     int threadCount  = argc > 3 ? atoi(argv[3]) : 1;
     TT.requestedMB   = argc > 4 ? atoi(argv[4]) : HASH_DEFAULT;
+    PawnCacheMB      = argc > 5 ? atoi(argv[5]) : PAWN_CACHE_DEFAULT;
+    Limits.quiet     = json;
 
     Position pos;
     InitThreads(threadCount);
@@ -106,32 +241,40 @@ void Benchmark(int argc, char **argv) {
 
     int FENCount = sizeof(BenchmarkFENs) / sizeof(char *);
     BenchResult results[FENCount];
-    TimePoint totalElapsed = 1; // Avoid possible div/0
-    uint64_t totalNodes = 0;
 
     for (int i = 0; i < FENCount; ++i) {
 
-        printf("[# %2d] %s\n", i + 1, BenchmarkFENs[i]);
-
-        // Search
-        ParseFen(BenchmarkFENs[i], &pos);
-        ABORT_SIGNAL = false;
-        Limits.start = Now();
-        SearchPosition(&pos);
+        if (!json)
+            printf("[# %2d] %s\n", i + 1, BenchmarkFENs[i]);
 
-        // Collect results
         BenchResult *r = &results[i];
-        r->elapsed = TimeSince(Limits.start);
-        r->nodes   = TotalNodes();
-        r->score   = Threads->rootMoves[0].score;
-        r->best    = Threads->rootMoves[0].move;
-
-        totalElapsed += r->elapsed;
-        totalNodes   += r->nodes;
+        r->elapsed  = BenchSearch(&pos, BenchmarkFENs[i]);
+        r->nodes    = TotalNodes();
+        r->score    = Threads->rootMoves[0].score;
+        r->best     = Threads->rootMoves[0].move;
+        r->depth    = MIN(Threads->depth, Limits.depth);
+        r->seldepth = Threads->seldepth;
+        r->hashFull = HashFull();
+        r->ttProbes = ThreadTotal(counters.ttProbes);
+        r->ttHits   = ThreadTotal(counters.ttHits);
+
+        t.elapsed    += r->elapsed;
+        t.nodes      += r->nodes;
+        t.ttProbes   += r->ttProbes;
+        t.ttHits     += r->ttHits;
+        t.pawnHits   += ThreadTotal(pawnCache.hits);
+        t.pawnMisses += ThreadTotal(pawnCache.misses);
+        t.evalHits   += ThreadTotal(evalCache.hits);
+        t.evalMisses += ThreadTotal(evalCache.misses);
 
         ClearTT();
     }
 
+    ThreadDispatchLatency(&t.pooled, &t.spawned);
+
+    if (json)
+        return PrintBenchJSON(results, FENCount, &t);
+
     puts("======================================================");
 
     for (int i = 0; i < FENCount; ++i) {
@@ -143,11 +286,166 @@ void Benchmark(int argc, char **argv) {
 
     puts("======================================================");
 
+    printf("CPU:     %s\n", CPUPath());
+    printf("STARTUP: %7.2f ms\n", t.startup);
+    printf("THREADS: %7.1f us pooled %7.1f us spawned per search\n", t.pooled, t.spawned);
+    printf("TT:      %7.2f %% hits\n", 100.0 * t.ttHits / (t.ttProbes + 1));
+    printf("PAWNS:   %7.2f %% hits %13" PRIu64 " misses\n",
+           100.0 * t.pawnHits / (t.pawnHits + t.pawnMisses + 1), t.pawnMisses);
+    printf("EVALS:   %7.2f %% hits %13" PRIu64 " misses\n",
+           100.0 * t.evalHits / (t.evalHits + t.evalMisses + 1), t.evalMisses);
     printf("OVERALL: %7" PRIi64 " ms %13" PRIu64 " nodes %10d nps\n",
-           totalElapsed, totalNodes, (int)(1000.0 * totalNodes / totalElapsed));
+           t.elapsed, t.nodes, (int)(1000.0 * t.nodes / t.elapsed));
 }
 
-#ifdef DEV
+typedef struct SMPResult {
+    int threads;
+    uint64_t nodes;
+    TimePoint elapsed;
+    TimePoint ttdElapsed;
+    int agree;
+} SMPResult;
+
+static int CPUCount() {
+#if defined(__linux__)
+    return sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    return 8;
+#endif
+}
+
+// Searches the bench positions with 1, 2, 4 .. N threads, each for a fixed time
+// and to the depth 1 thread reached in that time, to show where lazy smp stops scaling
+void SMPBenchmark(int argc, char **argv) {
+
+    // Default 500ms per position, up to one thread per cpu and 32MB hash
+    int ms         = argc > 2 ? atoi(argv[2]) : 500;
+    int maxThreads = argc > 3 ? atoi(argv[3]) : CPUCount();
+    TT.requestedMB = argc > 4 ? atoi(argv[4]) : HASH_DEFAULT;
+
+    maxThreads = MAX(1, maxThreads);
+
+    const int FENCount = sizeof(BenchmarkFENs) / sizeof(char *);
+    Depth targetDepth[FENCount];
+    Move best[32][FENCount];
+    SMPResult results[32] = { 0 };
+    int configs = 0;
+
+    Position pos;
+    Limits.quiet = true;
+
+    for (int threads = 1; ; threads = MIN(2 * threads, maxThreads)) {
+
+        printf("Running %d threads\n", threads);
+        fflush(stdout);
+
+        SMPResult *r = &results[configs];
+        r->threads = threads;
+
+        InitThreads(threads);
+        InitTT();
+
+        for (int i = 0; i < FENCount; ++i) {
+
+            // Fixed time
+            Limits.timelimit = true;
+            Limits.movetime  = ms;
+            Limits.depth     = MAX_PLY;
+            r->elapsed += BenchSearch(&pos, BenchmarkFENs[i]);
+            r->nodes   += TotalNodes();
+            best[configs][i] = Threads->rootMoves[0].move;
+
+            // The last iteration is usually cut short, count the one before as reached
+            if (threads == 1)
+                targetDepth[i] = MAX(1, Threads->depth - 1);
+
+            ClearTT();
+
+            // Time to depth
+            Limits.timelimit = false;
+            Limits.movetime  = 0;
+            Limits.depth     = targetDepth[i];
+            r->ttdElapsed += BenchSearch(&pos, BenchmarkFENs[i]);
+
+            ClearTT();
+        }
+
+        configs++;
+
+        if (threads == maxThreads) break;
+    }
+
+    // The most threads are taken to find the best moves
+    for (int c = 0; c < configs; ++c)
+        for (int i = 0; i < FENCount; ++i)
+            results[c].agree += best[c][i] == best[configs-1][i];
+
+    const SMPResult *base = &results[0];
+    const double baseNPS = 1000.0 * base->nodes / (base->elapsed + 1);
+
+    puts("======================================================");
+    puts("THREADS        NPS  SCALING  EFFIC   TTD ms  SPEEDUP  AGREE");
+
+    for (int c = 0; c < configs; ++c) {
+        const SMPResult *r = &results[c];
+        double nps = 1000.0 * r->nodes / (r->elapsed + 1);
+        printf("%7d %10.0f %7.2fx %5.0f%% %8" PRIi64 " %7.2fx %5.1f%%\n",
+               r->threads, nps, nps / baseNPS, 100.0 * nps / baseNPS / r->threads,
+               r->ttdElapsed, (double)base->ttdElapsed / (r->ttdElapsed + 1),
+               100.0 * r->agree / FENCount);
+    }
+
+    puts("======================================================");
+    printf("Best moves are compared to %d threads, time to depth is to the depth 1 thread reached\n",
+           results[configs-1].threads);
+}
+
+// Subtree counts from earlier perft calls, shared by all threads
+typedef struct PerftEntry {
+    Key check;     // key ^ data, so entries torn by racing threads fail to match
+    uint64_t data; // nodes << 8 | depth
+} PerftEntry;
+
+int PerftHashMB = 0;
+
+static PerftEntry *PerftTable;
+static uint64_t PerftMask;
+
+// Allocates an empty perft hash of the requested size, or none if 0
+static void InitPerftHash() {
+
+    if (!PerftHashMB) return;
+
+    uint64_t count = 1;
+    while (2 * count * sizeof(PerftEntry) <= (uint64_t)PerftHashMB * 1024 * 1024)
+        count *= 2;
+
+    PerftTable = calloc(count, sizeof(PerftEntry));
+    PerftMask = count - 1;
+
+    if (!PerftTable)
+        printf("info string Failed to allocate %dMB for perft hash.\n", PerftHashMB);
+}
+
+INLINE bool ProbePerft(Key key, Depth depth, uint64_t *nodes) {
+
+    PerftEntry *entry = &PerftTable[key & PerftMask];
+    Key check = entry->check;
+    uint64_t data = entry->data;
+
+    if ((check ^ data) != key || (data & 0xFF) != (uint64_t)depth)
+        return false;
+
+    *nodes = data >> 8;
+    return true;
+}
+
+INLINE void StorePerft(Key key, Depth depth, uint64_t nodes) {
+    PerftEntry *entry = &PerftTable[key & PerftMask];
+    uint64_t data = nodes << 8 | depth;
+    entry->check = key ^ data;
+    entry->data  = data;
+}
 
 // Helper for Perft()
 static uint64_t RecursivePerft(Position *pos, const Depth depth) {
@@ -156,21 +454,86 @@ static uint64_t RecursivePerft(Position *pos, const Depth depth) {
 
     uint64_t leafnodes = 0;
 
+    if (PerftTable && depth > 1 && ProbePerft(pos->key, depth, &leafnodes))
+        return leafnodes;
+
     MoveList list;
     list.count = list.next = 0;
-    GenAllMoves(pos, &list);
+    GenLegalMoves(pos, &list);
+
+    // All moves are legal, so the last ply needs only counting
+    if (depth == 1) return list.count;
 
     for (int i = 0; i < list.count; i++) {
-        if (!MakeMove(pos, list.moves[i].move)) continue;
+        MakeMove(pos, list.moves[i].move);
         leafnodes += RecursivePerft(pos, depth - 1);
         TakeMove(pos);
     }
 
+    if (PerftTable)
+        StorePerft(pos->key, depth, leafnodes);
+
     return leafnodes;
 }
 
+// Root moves handed out to the threads one at a time
+static struct {
+    const Position *root;
+    Depth depth;
+    MoveList moves;
+    uint64_t counts[256];
+    atomic_int next;
+} PerftRoot;
+
+static void *PerftWorker(void *voidThread) {
+
+    Thread *thread = voidThread;
+    Position *pos = &thread->pos;
+
+    memcpy(pos, PerftRoot.root, sizeof(Position));
+    pos->acc = NULL;
+
+    int i;
+    while ((i = atomic_fetch_add(&PerftRoot.next, 1)) < PerftRoot.moves.count) {
+        MakeMove(pos, PerftRoot.moves.moves[i].move);
+        PerftRoot.counts[i] = RecursivePerft(pos, PerftRoot.depth - 1);
+        TakeMove(pos);
+    }
+
+    return NULL;
+}
+
+// Counts the leaf nodes below each root move, splitting the root moves
+// over all threads. Prints the count of each move if dividing
+static uint64_t RunPerft(Position *pos, Depth depth, bool divide) {
+
+    if (depth <= 0) return 1;
+
+    PerftRoot.root  = pos;
+    PerftRoot.depth = depth;
+    PerftRoot.next  = 0;
+    PerftRoot.moves.count = PerftRoot.moves.next = 0;
+    GenLegalMoves(pos, &PerftRoot.moves);
+
+    InitPerftHash();
+    RunWithAllThreads(PerftWorker);
+
+    free(PerftTable);
+    PerftTable = NULL;
+
+    uint64_t leafNodes = 0;
+
+    for (int i = 0; i < PerftRoot.moves.count; ++i) {
+        leafNodes += PerftRoot.counts[i];
+        if (divide)
+            printf("%s: %" PRIu64 "\n", MoveToStr(PerftRoot.moves.moves[i].move), PerftRoot.counts[i]);
+    }
+
+    return leafNodes;
+}
+
 // Counts number of moves that can be made in a position to some depth
-void Perft(char *str) {
+void Perft(char *str, bool divide) {
 
     char *default_fen = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1";
 
@@ -178,14 +541,15 @@ void Perft(char *str) {
     char *d = strtok(NULL, " ");
     char *fen = strtok(NULL, "\0") ?: default_fen;
 
+    Position pos;
     Depth depth = d ? atoi(d) : 5;
-    ParseFen(fen, &Threads->pos);
+    ParseFen(fen, &pos);
 
     printf("\nPerft starting:\nDepth : %d\nFEN   : %s\n", depth, fen);
     fflush(stdout);
 
     const TimePoint start = Now();
-    uint64_t leafNodes = RecursivePerft(&Threads->pos, depth);
+    uint64_t leafNodes = RunPerft(&pos, depth, divide);
     const TimePoint elapsed = TimeSince(start) + 1;
 
     printf("\nPerft complete:"
@@ -196,8 +560,65 @@ void Perft(char *str) {
     fflush(stdout);
 }
 
+// Positions with known perft results, from https://www.chessprogramming.org/Perft_Results
+static const struct {
+    const char *fen;
+    Depth depth;
+    uint64_t nodes;
+} PerftPositions[] = {
+    { START_FEN, 6, 119060324 },
+    { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 5, 193690690 },
+    { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 7, 178633661 },
+    { "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5, 15833292 },
+    { "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 5, 89941194 },
+    { "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 5, 164075551 },
+};
+
+// Runs perft on positions with known results, checking move generation and
+// timing it. Returns whether all counts were correct
+bool PerftBenchmark(int argc, char **argv) {
+
+    // Default 1 thread and no perft hash
+    int threadCount = argc > 2 ? atoi(argv[2]) : 1;
+    PerftHashMB     = argc > 3 ? atoi(argv[3]) : 0;
+
+    InitThreads(threadCount);
+
+    int count = sizeof(PerftPositions) / sizeof(PerftPositions[0]);
+    int failed = 0;
+    uint64_t totalNodes = 0;
+    TimePoint totalElapsed = 1; // Avoid possible div/0
+
+    for (int i = 0; i < count; ++i) {
+
+        Position pos;
+        ParseFen(PerftPositions[i].fen, &pos);
+
+        TimePoint start = Now();
+        uint64_t nodes = RunPerft(&pos, PerftPositions[i].depth, false);
+        TimePoint elapsed = TimeSince(start);
+
+        bool correct = nodes == PerftPositions[i].nodes;
+        failed += !correct;
+        totalNodes += nodes;
+        totalElapsed += elapsed;
+
+        printf("[# %2d] depth %d %12" PRIu64 " nodes %7" PRIi64 " ms  %s  %s\n",
+               i + 1, PerftPositions[i].depth, nodes, elapsed, correct ? "ok  " : "FAIL", PerftPositions[i].fen);
+        fflush(stdout);
+    }
+
+    puts("======================================================");
+
+    printf("OVERALL: %7" PRIi64 " ms %13" PRIu64 " nodes %10" PRIu64 " nps  %s\n",
+           totalElapsed, totalNodes, totalNodes * 1000 / totalElapsed, failed ? "FAILED" : "all correct");
+
+    return !failed;
+}
+
+#ifdef DEV
 void PrintEval(Position *pos) {
-    printf("%d\n", EvalPositionWhitePov(pos, Threads->pawnCache));
+    printf("%d\n", EvalPositionWhitePov(pos, &Threads->pawnCache));
     fflush(stdout);
 }
 #endif
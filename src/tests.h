@@ -23,8 +23,12 @@
 
 
 void Benchmark(int argc, char **argv);
+void SMPBenchmark(int argc, char **argv);
+bool PerftBenchmark(int argc, char **argv);
+void Perft(char *str, bool divide);
+
+extern int PerftHashMB;
 
 #ifdef DEV
-void Perft(char *line);
 void PrintEval(Position *pos);
 #endif
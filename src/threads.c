@@ -16,38 +16,204 @@
   along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <pthread.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__linux__)
+    #include <sys/mman.h>
+#endif
+
 #include "makemove.h"
 #include "move.h"
 #include "movegen.h"
+#include "numa.h"
 #include "threads.h"
 
 
 Thread *Threads;
-static pthread_t *pthreads;
+
+int PawnCacheMB = PAWN_CACHE_DEFAULT;
+bool PawnCacheShared = false;
+static PawnEntry *SharedPawnTable;
+static uint64_t PawnCacheEntries;
+
+#if !defined(__linux__)
+static void *ThreadMem;
+#endif
 
 // Used for letting the main thread sleep without using cpu
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t sleepCondition = PTHREAD_COND_INITIALIZER;
 
 
-// Allocates memory for thread structs
+// Thread sleeps until given a job, runs it, and goes back to sleep
+static void *IdleLoop(void *voidThread) {
+
+    Thread *thread = voidThread;
+
+    // Bind to a NUMA node or cpu before touching any memory
+    if (thread->bind)
+        BindThread(thread->index);
+
+    pthread_mutex_lock(&thread->mutex);
+
+    while (true) {
+
+        while (!thread->job && !thread->exit)
+            pthread_cond_wait(&thread->sleepCondition, &thread->mutex);
+
+        if (thread->exit) break;
+
+        void *(*job)(void *) = thread->job;
+        void *arg = thread->jobArg;
+
+        pthread_mutex_unlock(&thread->mutex);
+        job(arg);
+        pthread_mutex_lock(&thread->mutex);
+
+        // Let anyone waiting know the job is done
+        thread->job = NULL;
+        pthread_cond_broadcast(&thread->sleepCondition);
+    }
+
+    pthread_mutex_unlock(&thread->mutex);
+
+    return NULL;
+}
+
+// Frees the pawn caches of all threads
+static void FreePawnCaches() {
+
+    if (SharedPawnTable)
+        free(SharedPawnTable);
+    else
+        for (int i = 0; i < Threads->count; ++i)
+            free(Threads[i].pawnCache.table);
+
+    SharedPawnTable = NULL;
+}
+
+// Allocates the pawn cache of the thread it runs in, unless it is shared
+static void *AllocPawnCache(void *voidThread) {
+
+    Thread *thread = voidThread;
+    PawnCache *pc = &thread->pawnCache;
+
+    pc->table = SharedPawnTable ? SharedPawnTable : calloc(PawnCacheEntries, sizeof(PawnEntry));
+    pc->mask  = PawnCacheEntries - 1;
+
+    if (!pc->table) {
+        printf("Failed to allocate %dMB for pawn cache.\n", PawnCacheMB);
+        exit(EXIT_FAILURE);
+    }
+
+    // Write to each page so it is placed on the node of this thread
+    if (!SharedPawnTable)
+        memset(pc->table, 0, PawnCacheEntries * sizeof(PawnEntry));
+
+    return NULL;
+}
+
+// Touch our own memory first, so the kernel places it on the node we run on
+static void *FirstTouch(void *voidThread) {
+    Thread *thread = voidThread;
+    memset(thread, 0, offsetof(Thread, index));
+    return NULL;
+}
+
+// Allocates a pawn cache for each thread, or one they all share,
+// using the largest power of two number of entries that fits
+void InitPawnCaches() {
+
+    FreePawnCaches();
+
+    PawnCacheEntries = 1;
+    while (2 * PawnCacheEntries * sizeof(PawnEntry) <= (uint64_t)PawnCacheMB * 1024 * 1024)
+        PawnCacheEntries *= 2;
+
+    if (PawnCacheShared && !(SharedPawnTable = calloc(PawnCacheEntries, sizeof(PawnEntry)))) {
+        printf("Failed to allocate %dMB for pawn cache.\n", PawnCacheMB);
+        exit(EXIT_FAILURE);
+    }
+
+    // Each thread allocates its own cache
+    RunWithAllThreads(AllocPawnCache);
+}
+
+// Tells all threads to exit and frees their memory
+static void DestroyThreads() {
+
+    for (int i = 0; i < Threads->count; ++i) {
+        pthread_mutex_lock(&Threads[i].mutex);
+        Threads[i].exit = true;
+        pthread_cond_broadcast(&Threads[i].sleepCondition);
+        pthread_mutex_unlock(&Threads[i].mutex);
+    }
+
+    for (int i = 0; i < Threads->count; ++i)
+        pthread_join(Threads[i].pthread, NULL),
+        pthread_mutex_destroy(&Threads[i].mutex),
+        pthread_cond_destroy(&Threads[i].sleepCondition);
+
+    FreePawnCaches();
+
+#if defined(__linux__)
+    munmap(Threads, Threads->count * sizeof(Thread));
+#else
+    free(ThreadMem);
+#endif
+}
+
+// Allocates memory for thread structs and starts the threads
 void InitThreads(int count) {
 
-    if (Threads)  free(Threads);
-    if (pthreads) free(pthreads);
+    if (Threads) DestroyThreads();
 
-    Threads  = calloc(count, sizeof(Thread));
-    pthreads = calloc(count, sizeof(pthread_t));
+#if defined(__linux__)
+    // Mapped memory is zeroed and untouched, leaving each
+    // thread to decide the node its own memory goes on
+    Threads = mmap(NULL, count * sizeof(Thread), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (Threads == MAP_FAILED) Threads = NULL;
+#else
+    // Align to a page so the padded counters and thread setup line up
+    ThreadMem = calloc(1, count * sizeof(Thread) + 4096 - 1);
+    Threads = ThreadMem ? (Thread *)(((uintptr_t)ThreadMem + 4096 - 1) & ~(uintptr_t)(4096 - 1)) : NULL;
+#endif
+
+    if (!Threads) {
+        printf("Failed to allocate memory for %d threads.\n", count);
+        exit(EXIT_FAILURE);
+    }
+
+    bool bind = NumaBind || PinPolicy != PIN_NONE;
+
+    if (bind) {
+        InitTopology();
+        if (PinPolicy != PIN_NONE)
+            printf("info string Pinning %d threads to cpus\n", count);
+        else
+            printf("info string Binding %d threads to %d NUMA nodes\n", count, NodeCount);
+    }
 
     // Each thread knows its own index and total thread count
     for (int i = 0; i < count; ++i)
         Threads[i].index = i,
-        Threads[i].count = count;
+        Threads[i].count = count,
+        Threads[i].bind  = bind;
+
+    // Threads are kept alive between searches, sleeping while idle
+    for (int i = 0; i < count; ++i)
+        pthread_mutex_init(&Threads[i].mutex, NULL),
+        pthread_cond_init(&Threads[i].sleepCondition, NULL),
+        pthread_create(&Threads[i].pthread, NULL, IdleLoop, &Threads[i]);
+
+    // Wait for the touch to finish so it can't race the first search
+    if (bind)
+        RunWithAllThreads(FirstTouch);
+
+    InitPawnCaches();
 }
 
 // Sorts all rootmoves searched by multiPV
@@ -67,20 +233,22 @@ void SortRootMoves(Thread *thread, int multiPV) {
     }
 }
 
-// Tallies the nodes searched by all threads
-uint64_t TotalNodes() {
+// Tallies a 64-bit counter at the given offset in each thread
+uint64_t SumThreads(size_t offset) {
     uint64_t total = 0;
     for (int i = 0; i < Threads->count; ++i)
-        total += Threads[i].pos.nodes;
+        total += *(uint64_t *)((char *)&Threads[i] + offset);
     return total;
 }
 
+// Tallies the nodes searched by all threads
+uint64_t TotalNodes() {
+    return ThreadTotal(pos.nodes);
+}
+
 // Tallies the tbhits of all threads
 uint64_t TotalTBHits() {
-    uint64_t total = 0;
-    for (int i = 0; i < Threads->count; ++i)
-        total += Threads[i].tbhits;
-    return total;
+    return ThreadTotal(counters.tbhits);
 }
 
 // Setup threads for a new search
@@ -90,7 +258,11 @@ void PrepareSearch(Position *pos, Move searchmoves[]) {
     for (Thread *t = Threads; t < Threads + Threads->count; ++t) {
         memset(t, 0, offsetof(Thread, pos));
         memcpy(&t->pos, pos, sizeof(Position));
+        t->pos.acc = UseNNUE ? t->accStack : NULL;
+        if (UseNNUE) ResetAccumulator(t->accStack);
         t->rootMoveCount = rootMoveCount;
+        t->pawnCache.hits = t->pawnCache.misses = 0;
+        t->evalCache.hits = t->evalCache.misses = 0;
         for (Depth d = 0; d <= MAX_PLY; ++d)
             (t->ss+SS_OFFSET+d)->ply = d;
         for (Depth d = -4; d < 0; ++d)
@@ -98,45 +270,70 @@ void PrepareSearch(Position *pos, Move searchmoves[]) {
     }
 }
 
+// Wakes up a thread to run the provided function, waiting for any previous job to finish first
+void RunJob(Thread *thread, void *(*func)(void *), void *arg) {
+    pthread_mutex_lock(&thread->mutex);
+    while (thread->job)
+        pthread_cond_wait(&thread->sleepCondition, &thread->mutex);
+    thread->job = func;
+    thread->jobArg = arg;
+    pthread_cond_broadcast(&thread->sleepCondition);
+    pthread_mutex_unlock(&thread->mutex);
+}
+
+// Waits for a thread to finish its current job, if any
+void WaitForJob(Thread *thread) {
+    pthread_mutex_lock(&thread->mutex);
+    while (thread->job)
+        pthread_cond_wait(&thread->sleepCondition, &thread->mutex);
+    pthread_mutex_unlock(&thread->mutex);
+}
+
 // Start the main thread running the provided function
 void StartMainThread(void *(*func)(void *), Position *pos) {
-    pthread_create(&pthreads[0], NULL, func, pos);
-    pthread_detach(pthreads[0]);
+    RunJob(&Threads[0], func, pos);
 }
 
-static bool helpersActive = false;
-
 // Start helper threads running the provided function
 void StartHelpers(void *(*func)(void *)) {
-    helpersActive = true;
     for (int i = 1; i < Threads->count; ++i)
-        pthread_create(&pthreads[i], NULL, func, &Threads[i]);
+        RunJob(&Threads[i], func, &Threads[i]);
 }
 
 // Wait for helper threads to finish
 void WaitForHelpers() {
-    if (!helpersActive) return;
     for (int i = 1; i < Threads->count; ++i)
-        pthread_join(pthreads[i], NULL);
-    helpersActive = false;
+        WaitForJob(&Threads[i]);
+}
+
+static void *ThreadReset(void *voidThread) {
+
+    Thread *thread = voidThread;
+
+    // A shared pawn cache only needs clearing once
+    if (!PawnCacheShared || !thread->index)
+        memset(thread->pawnCache.table, 0, (thread->pawnCache.mask + 1) * sizeof(PawnEntry));
+
+    memset(thread->history,        0, sizeof(thread->history));
+    memset(thread->pawnHistory,    0, sizeof(thread->pawnHistory));
+    memset(thread->captureHistory, 0, sizeof(thread->captureHistory));
+    memset(thread->continuation,   0, sizeof(thread->continuation));
+    memset(thread->evalCache.table, 0, sizeof(thread->evalCache.table));
+
+    return NULL;
 }
 
 // Reset all data that isn't reset each turn
 void ResetThreads() {
-    for (int i = 0; i < Threads->count; ++i)
-        memset(Threads[i].pawnCache,      0, sizeof(PawnCache)),
-        memset(Threads[i].history,        0, sizeof(Threads[i].history)),
-        memset(Threads[i].pawnHistory,    0, sizeof(Threads[i].pawnHistory)),
-        memset(Threads[i].captureHistory, 0, sizeof(Threads[i].captureHistory)),
-        memset(Threads[i].continuation,   0, sizeof(Threads[i].continuation));
+    RunWithAllThreads(ThreadReset);
 }
 
 // Run the given function once in each thread
 void RunWithAllThreads(void *(*func)(void *)) {
     for (int i = 0; i < Threads->count; ++i)
-        pthread_create(&pthreads[i], NULL, func, &Threads[i]);
+        RunJob(&Threads[i], func, &Threads[i]);
     for (int i = 0; i < Threads->count; ++i)
-        pthread_join(pthreads[i], NULL);
+        WaitForJob(&Threads[i]);
 }
 
 // Thread sleeps until it is woken up
@@ -18,14 +18,18 @@
 
 #pragma once
 
+#include <pthread.h>
+#include <stddef.h>
 #include <setjmp.h>
 
 #include "board.h"
 #include "evaluate.h"
+#include "nnue.h"
 #include "types.h"
 
 
 #define SS_OFFSET 10
+#define ThreadTotal(field) SumThreads(offsetof(Thread, field))
 #define MULTI_PV_MAX 64
 #define PAWN_HISTORY_SIZE 512
 
@@ -57,13 +61,45 @@ typedef struct RootMove {
     PV pv;
 } RootMove;
 
+// Counters written during search, padded to fill a cache line so
+// neither other threads' data nor the reporting reads share it
+typedef struct ThreadCounters {
+    CACHE_PAD uint64_t tbhits;
+    uint64_t tbProbes;
+    uint64_t tbProbeNs;
+    uint64_t tbCacheProbes;
+    uint64_t tbCacheHits;
+    uint64_t ttProbes;
+    uint64_t ttHits;
+} ThreadCounters;
+
+#ifdef STATS
+// How often each pruning, reduction and extension in AlphaBeta triggers,
+// counted by each thread in its own memory and summed after the search
+typedef struct SearchStats {
+    uint64_t ttCutoffs;
+    uint64_t pruningNodes;
+    uint64_t rfpCutoffs;
+    uint64_t nullMoveTries, nullMoveCutoffs;
+    uint64_t probCutTries, probCutCutoffs;
+    uint64_t historyPruned, seePruned;
+    uint64_t singularTries, singularExtensions[2], multiCuts, negativeExtensions;
+    uint64_t lmrSearches, lmrResearches;
+    uint64_t betaCutoffs, firstMoveCutoffs;
+} SearchStats;
+#endif
+
 typedef struct Thread {
 
     Stack ss[128];
     jmp_buf jumpBuffer;
-    uint64_t tbhits;
+    ThreadCounters counters;
+#ifdef STATS
+    SearchStats stats;
+#endif
     RootMove rootMoves[MULTI_PV_MAX];
     Depth depth;
+    Depth seldepth;
     int rootMoveCount;
     bool doPruning;
     bool uncertain;
@@ -71,23 +107,40 @@ typedef struct Thread {
 
     // Anything below here is not zeroed out between searches
     Position pos;
-    PawnCache pawnCache;
+    Accumulator accStack[MAX_PLY + 1];
     ButterflyHistory history;
     PawnHistory pawnHistory;
     CaptureToHistory captureHistory;
     ContinuationHistory continuation[2][2];
+    EvalCache evalCache;
+    PawnCache pawnCache;
 
-    int index;
+    // Set up by the thread starting this one, so kept on a page of
+    // their own to leave the rest for this thread to touch first
+    _Alignas(4096) int index;
     int count;
 
+    // Persistent OS thread that idles between jobs
+    pthread_t pthread;
+    pthread_mutex_t mutex;
+    pthread_cond_t sleepCondition;
+    void *(*job)(void *);
+    void *jobArg;
+    bool exit;
+    bool bind;
+
 } Thread;
 
 
 extern Thread *Threads;
+extern int PawnCacheMB;
+extern bool PawnCacheShared;
 
 
 void InitThreads(int threadCount);
+void InitPawnCaches();
 void SortRootMoves(Thread *thread, int multiPV);
+uint64_t SumThreads(size_t offset);
 uint64_t TotalNodes();
 uint64_t TotalTBHits();
 void PrepareSearch(Position *pos, Move searchmoves[]);
@@ -96,5 +149,7 @@ void StartHelpers(void *(*func)(void *));
 void WaitForHelpers();
 void ResetThreads();
 void RunWithAllThreads(void *(*func)(void *));
+void RunJob(Thread *thread, void *(*func)(void *), void *arg);
+void WaitForJob(Thread *thread);
 void Wait(atomic_bool *condition);
 void Wake();
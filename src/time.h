@@ -23,10 +23,15 @@
 #include "threads.h"
 
 
-INLINE TimePoint Now() {
+// Monotonic time in nanoseconds, for timing short operations
+INLINE uint64_t NowNs() {
     struct timespec t;
     clock_gettime(CLOCK_MONOTONIC, &t);
-    return t.tv_sec * 1000 + t.tv_nsec / 1000000;
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+INLINE TimePoint Now() {
+    return NowNs() / 1000000;
 }
 
 INLINE int TimeSince(const TimePoint tp) {
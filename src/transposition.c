@@ -18,36 +18,69 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #if defined(__linux__)
+    #include <fcntl.h>
     #include <sys/mman.h>
+    #include <unistd.h>
 #endif
 
 #include "makemove.h"
 #include "move.h"
 #include "movegen.h"
+#include "search.h"
 #include "transposition.h"
 
 
 TranspositionTable TT = { .requestedMB = HASH_DEFAULT };
 
+#define TT_FILE_VERSION 3
 
-// Probe the transposition table
-TTEntry* ProbeTT(const Key key, bool *ttHit) {
+// Header of a saved TT file, padded so the table after it stays cache line aligned
+typedef union {
+    struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t bucketSize;
+        uint64_t megabytes;
+        uint64_t count;
+        uint8_t generation;
+    };
+    char padding[64];
+} TTFileHeader;
+
+static const char TTFileMagic[8] = "WeissTT";
+
+
+// Probe the transposition table, copying the data of the returned entry to ttData
+TTEntry* ProbeTT(const Key key, TTEntry *ttData, bool *ttHit) {
 
     TTEntry* first = GetTTBucket(key)->entries;
 
-    for (TTEntry *entry = first; entry < first + BUCKET_SIZE; ++entry)
-        if (entry->key == (int32_t)key || !Bound(entry)) {
-            entry->genBound = TT.generation | Bound(entry);
-            return *ttHit = Bound(entry), entry;
+    for (TTEntry *entry = first; entry < first + BUCKET_SIZE; ++entry) {
+
+        // Verify a copy, as other threads may overwrite the entry at any time
+        *ttData = *entry;
+
+        if (EntryMatches(ttData, key) || !Bound(ttData)) {
+            entry->genBound = TT.generation | Bound(ttData);
+            return *ttHit = Bound(ttData), entry;
         }
 
+#ifdef DEV
+        if (EntryIsTorn(ttData, key))
+            atomic_fetch_add_explicit(&TT.tornEntries, 1, memory_order_relaxed);
+#endif
+    }
+
     TTEntry *replace = first;
     for (TTEntry *entry = first + 1; entry < first + BUCKET_SIZE; ++entry)
         if (EntryValue(replace) > EntryValue(entry))
             replace = entry;
 
+    *ttData = *replace;
+
     return *ttHit = false, replace;
 }
 
@@ -57,17 +90,22 @@ void StoreTTEntry(TTEntry *tte, Key key, Move move, int score, int eval, Depth d
     assert(ValidBound(bound));
     assert(ValidScore(score));
 
-    if (move || (int32_t)key != tte->key)
+    bool samePosition = EntryMatches(tte, key);
+
+    if (move || !samePosition)
         tte->move = move;
 
     // Store new data unless it would overwrite data about the same
     // position searched to a higher depth.
-    if ((int32_t)key != tte->key || depth + 4 >= tte->depth || bound == BOUND_EXACT)
-        tte->key   = key,
+    if (!samePosition || depth + 4 >= tte->depth || bound == BOUND_EXACT)
         tte->score = score,
         tte->eval  = eval,
         tte->depth = depth,
         tte->genBound = TT.generation | bound;
+
+    // Key is written last, sealing the new data with its checksum
+    tte->check = Checksum(tte);
+    tte->key = (int32_t)key;
 }
 
 // Estimates the load factor of the transposition table (1 = 0.1%)
@@ -109,6 +147,84 @@ void ClearTT() {
     TT.dirty = false;
 }
 
+#if defined(__linux__)
+
+#ifndef MAP_HUGE_SHIFT
+    #define MAP_HUGE_SHIFT 26
+#endif
+
+// Tries to map memory backed by explicitly reserved huge pages of size 2^pageShift
+static void *MapHugePages(uint64_t bytes, int pageShift) {
+
+    uint64_t pageSize = 1ull << pageShift;
+    uint64_t size = (bytes + pageSize - 1) & ~(pageSize - 1);
+
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (pageShift << MAP_HUGE_SHIFT), -1, 0);
+
+    if (mem == MAP_FAILED)
+        return NULL;
+
+    TT.mappedBytes = size;
+    return mem;
+}
+
+// Reads how much of the mapping containing addr the kernel backs with transparent huge pages
+static uint64_t TransparentHugeBytes(void *addr) {
+
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) return 0;
+
+    char line[256];
+    bool found = false;
+    uint64_t start, end, kB = 0;
+
+    while (fgets(line, sizeof(line), smaps)) {
+        if (sscanf(line, "%" SCNx64 "-%" SCNx64, &start, &end) == 2)
+            found = start <= (uintptr_t)addr && (uintptr_t)addr < end;
+        else if (found && sscanf(line, "AnonHugePages: %" SCNu64 " kB", &kB) == 1)
+            break;
+    }
+
+    fclose(smaps);
+
+    return kB * 1024;
+}
+#endif
+
+// Prints what kind of pages ended up backing the TT
+static void ReportPages() {
+
+    if (Limits.quiet) return;
+
+#if defined(__linux__)
+    if (TT.pages == PAGES_THP) {
+        uint64_t huge = TransparentHugeBytes(TT.mem);
+        printf("info string Hash uses transparent huge pages for %" PRIu64 " of %" PRIu64 "MB\n",
+               huge / (1024 * 1024), TT.currentMB);
+        return;
+    }
+#endif
+
+    printf("info string Hash uses %s\n", TT.pages == PAGES_1GB ? "1GB huge pages"
+                                        : TT.pages == PAGES_2MB ? "2MB huge pages"
+                                                                : "normal pages");
+}
+
+// Frees the memory of the transposition table, whether allocated or mapped from a file
+static void FreeTT() {
+#if defined(__linux__)
+    if (TT.mappedBytes)
+        munmap(TT.mem, TT.mappedBytes);
+    else
+#endif
+        free(TT.mem);
+
+    TT.mem = NULL;
+    TT.mappedBytes = 0;
+    TT.currentMB = 0;
+}
+
 // Allocates memory for the transposition table
 void InitTT() {
 
@@ -118,19 +234,32 @@ void InitTT() {
 
     // Free memory if previously allocated
     if (TT.mem)
-        free(TT.mem);
+        FreeTT();
 
     uint64_t bytes = TT.requestedMB * 1024 * 1024;
 
 #if defined(__linux__)
-    // Align on 2MB boundaries and request Huge Pages
-    TT.mem = aligned_alloc(2 * 1024 * 1024, bytes);
+    // Try explicitly reserved 1GB then 2MB pages, these need to be set up
+    // by the administrator (hugetlbfs), and then fall back to transparent
+    // huge pages, which the kernel may or may not grant
+    if (bytes >= (1ull << 30) && (TT.mem = MapHugePages(bytes, 30)))
+        TT.pages = PAGES_1GB;
+
+    else if ((TT.mem = MapHugePages(bytes, 21)))
+        TT.pages = PAGES_2MB;
+
+    else {
+        // Align on 2MB boundaries and request Huge Pages
+        TT.mem = aligned_alloc(2 * 1024 * 1024, bytes);
+        TT.pages = TT.mem && !madvise(TT.mem, bytes, MADV_HUGEPAGE) ? PAGES_THP : PAGES_NORMAL;
+    }
+
     TT.table = (TTBucket *)TT.mem;
-    madvise(TT.table, bytes, MADV_HUGEPAGE);
 #else
     // Align on cache line
     TT.mem = malloc(bytes + 64 - 1);
     TT.table = (TTBucket *)(((uintptr_t)TT.mem + 64 - 1) & ~(64 - 1));
+    TT.pages = PAGES_NORMAL;
 #endif
 
     // Allocation failed
@@ -145,4 +274,106 @@ void InitTT() {
     // Zero out the memory
     TT.dirty = true;
     ClearTT();
+
+    ReportPages();
+}
+
+// Saves the transposition table to a file
+void SaveTT(const char *path) {
+
+    // Save the table as it is, a pending resize would throw it away
+    if (!TT.mem)
+        InitTT();
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        printf("info string Failed to open %s for writing.\n", path);
+        return;
+    }
+
+    TTFileHeader header = { 0 };
+    memcpy(header.magic, TTFileMagic, sizeof(TTFileMagic));
+    header.version    = TT_FILE_VERSION;
+    header.bucketSize = sizeof(TTBucket);
+    header.megabytes  = TT.currentMB;
+    header.count      = TT.count;
+    header.generation = TT.generation;
+
+    bool success =    fwrite(&header, sizeof(header), 1, file) == 1
+                   && fwrite(TT.table, sizeof(TTBucket), TT.count, file) == TT.count;
+
+    fclose(file);
+
+    if (success) printf("info string Hash saved to %s.\n", path);
+    else         printf("info string Failed to write hash to %s.\n", path);
+}
+
+// Restores a transposition table saved by SaveTT
+void LoadTT(const char *path) {
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("info string Failed to open %s.\n", path);
+        return;
+    }
+
+    TTFileHeader header;
+    struct stat st;
+
+    // A truncated file would fault when the missing pages are touched
+    if (   fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, TTFileMagic, sizeof(TTFileMagic))
+        || header.version != TT_FILE_VERSION
+        || header.bucketSize != sizeof(TTBucket)
+        || header.count != header.megabytes * 1024 * 1024 / sizeof(TTBucket)
+        || fstat(fileno(file), &st)
+        || (uint64_t)st.st_size != sizeof(header) + header.count * sizeof(TTBucket)) {
+        printf("info string %s is not a compatible hash file.\n", path);
+        fclose(file);
+        return;
+    }
+
+    uint64_t bytes = header.count * sizeof(TTBucket);
+
+    FreeTT();
+
+#if defined(__linux__)
+    // Map the file privately so pages are only read in when first touched,
+    // and writes during search never go back to the file
+    uint64_t fileBytes = sizeof(header) + bytes;
+    void *mem = mmap(NULL, fileBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+    fclose(file);
+
+    if (mem == MAP_FAILED) {
+        printf("info string Failed to map %s.\n", path);
+        InitTT();
+        return;
+    }
+
+    madvise(mem, fileBytes, MADV_WILLNEED);
+
+    TT.mem = mem;
+    TT.mappedBytes = fileBytes;
+    TT.pages = PAGES_FILE;
+    TT.table = (TTBucket *)((char *)mem + sizeof(header));
+#else
+    TT.requestedMB = header.megabytes;
+    InitTT();
+    bool success = fread(TT.table, sizeof(TTBucket), header.count, file) == header.count;
+    fclose(file);
+
+    if (!success) {
+        printf("info string Failed to read %s.\n", path);
+        TT.dirty = true;
+        ClearTT();
+        return;
+    }
+#endif
+
+    TT.count       = header.count;
+    TT.currentMB   = TT.requestedMB = header.megabytes;
+    TT.generation  = header.generation;
+    TT.dirty       = false; // Keep the loaded entries on the next ucinewgame
+
+    printf("info string Hash loaded from %s (%" PRIu64 "MB).\n", path, TT.currentMB);
 }
@@ -28,7 +28,7 @@
 #define HASH_MAX ((int)(pow(2, 40) * sizeof(TTBucket) / (1024 * 1024))) // 40 could be set as high as 64
 #define HASH_DEFAULT 32
 
-#define BUCKET_SIZE 2
+#define BUCKET_SIZE 4
 
 #define ValidBound(bound) (bound >= BOUND_UPPER && bound <= BOUND_EXACT)
 #define ValidScore(score) (score >= -MATE && score <= MATE)
@@ -36,6 +36,9 @@
 
 enum { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT };
 
+// Kinds of pages backing the TT, from largest to smallest
+enum { PAGES_1GB, PAGES_2MB, PAGES_THP, PAGES_NORMAL, PAGES_FILE };
+
 // Constants used for operating on the combined bound + generation field
 enum {
     TT_BOUND_BITS = 2,                              // Number of bits representing bound
@@ -53,31 +56,60 @@ typedef struct {
     int16_t eval;
     uint8_t depth;
     uint8_t genBound;
+    uint16_t check;
 } TTEntry;
 
-typedef struct {
-    TTEntry entries[2];
+typedef struct __attribute__((aligned(64))) {
+    TTEntry entries[BUCKET_SIZE];
 } TTBucket;
 
+static_assert(sizeof(TTBucket) == 64, "TTBucket should be one cache line");
+
 typedef struct {
     void *mem;
+    uint64_t mappedBytes;
+    int pages;
     TTBucket *table;
     uint64_t count;
     uint64_t currentMB;
     uint64_t requestedMB;
     uint8_t generation;
     bool dirty;
+#ifdef DEV
+    atomic_uint_fast64_t tornEntries;
+#endif
 } TranspositionTable;
 
 
 extern TranspositionTable TT;
 
 
-INLINE uint8_t      Bound(TTEntry *entry) { return entry->genBound & TT_BOUND_MASK; }
-INLINE uint8_t Generation(TTEntry *entry) { return entry->genBound & TT_GEN_MASK; }
-INLINE uint8_t        Age(TTEntry *entry) { return (TT_GEN_CYCLE + TT.generation - entry->genBound) & TT_GEN_MASK; }
+INLINE uint8_t      Bound(const TTEntry *entry) { return entry->genBound & TT_BOUND_MASK; }
+INLINE uint8_t Generation(const TTEntry *entry) { return entry->genBound & TT_GEN_MASK; }
+INLINE uint8_t        Age(const TTEntry *entry) { return (TT_GEN_CYCLE + TT.generation - entry->genBound) & TT_GEN_MASK; }
 
-INLINE int EntryValue(TTEntry *entry) { return entry->depth - Age(entry); }
+INLINE int EntryValue(const TTEntry *entry) { return entry->depth - Age(entry); }
+
+// Hashes the data of an entry down to 16 bits. The generation is left out
+// so it can be refreshed on probes without rewriting the key.
+INLINE uint16_t Checksum(const TTEntry *entry) {
+    uint64_t data =  (uint64_t)entry->move
+                  ^ ((uint64_t)(entry->depth << TT_BOUND_BITS | Bound(entry)) << 27)
+                  ^ ((uint64_t)(uint16_t)entry->score << 32)
+                  ^ ((uint64_t)(uint16_t)entry->eval  << 48);
+    return (data * 0x9E3779B97F4A7C15ull) >> 48;
+}
+
+// The checksum of the data is stored next to it, so an entry torn by
+// concurrent writes from different threads no longer matches either position
+INLINE bool EntryMatches(const TTEntry *entry, Key key) {
+    return entry->key == (int32_t)key && entry->check == Checksum(entry);
+}
+
+// The right key with data that fails its checksum can only come from a torn write
+INLINE bool EntryIsTorn(const TTEntry *entry, Key key) {
+    return entry->key == (int32_t)key && entry->check != Checksum(entry);
+}
 
 // Store terminal scores as distance from the current position to mate/TB
 INLINE int ScoreToTT (const int score, const uint8_t ply) {
@@ -108,6 +140,7 @@ INLINE TTBucket *GetTTBucket(Key key) {
     return &TT.table[TTIndex(key)];
 }
 
+// Buckets are cache line aligned, so this fetches every entry a probe will look at
 INLINE void TTPrefetch(Key key) {
     __builtin_prefetch(GetTTBucket(key));
 }
@@ -120,10 +153,15 @@ INLINE void RequestTTSize(int megabytes) {
 INLINE void TTNewSearch() {
     TT.generation += TT_GEN_DELTA;
     TT.dirty = true;
+#ifdef DEV
+    TT.tornEntries = 0;
+#endif
 }
 
-TTEntry* ProbeTT(Key key, bool *ttHit);
+TTEntry* ProbeTT(Key key, TTEntry *ttData, bool *ttHit);
 void StoreTTEntry(TTEntry *tte, Key key, Move move, int score, int eval, Depth depth, int bound);
 int HashFull();
 void ClearTT();
 void InitTT();
+void SaveTT(const char *path);
+void LoadTT(const char *path);
@@ -26,12 +26,26 @@
 
 #ifdef TUNE
 
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+#include <sys/stat.h>
+
+#if defined(__linux__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
 #include "../board.h"
 #include "../evaluate.h"
+#include "../time.h"
 #include "tuner.h"
 
 
@@ -81,10 +95,23 @@ extern const int KingLineDanger[28];
 extern const int Mobility[4][28];
 
 
-EvalTrace T, EmptyTrace;
+// Each thread traces its own evaluations when converting the dataset
+_Thread_local EvalTrace T;
+EvalTrace EmptyTrace;
 
-TTuple *TupleStack;
-int TupleStackSize;
+static TConfig Config = {
+    .epochs       = MAXEPOCHS,
+    .reporting    = REPORTING,
+    .lrStep       = LRSTEPRATE,
+    .lr           = LRRATE,
+    .lrDrop       = LRDROPRATE,
+    .beta1        = BETA_1,
+    .beta2        = BETA_2,
+    .K            = KVALUE,
+    .batchSize    = BATCHSIZE,
+    .validation   = NVALIDATION,
+    .validateFreq = VALIDATEFREQ,
+};
 
 
 static void PrintSingle_(char *name, TIntVector params, int i, char *filler) {
@@ -355,16 +382,11 @@ static void InitCoefficients(TCoeffs coeffs) {
     }
 }
 
-static double LinearEvaluation(TEntry *entry, TVector params, int base) {
-
-    double midgame = MgScore(base);
-    double endgame = EgScore(base);
+INLINE const int16_t *EntryTuples(const TEntry *entry) {
+    return (const int16_t *)((const char *)entry + entry->tupleOffset);
+}
 
-    for (int i = 0; i < entry->ntuples; i++) {
-        int termIndex = entry->tuples[i].index;
-        midgame += (double) entry->tuples[i].coeff * params[termIndex][MG];
-        endgame += (double) entry->tuples[i].coeff * params[termIndex][EG];
-    }
+static double PhasedEvaluation(const TEntry *entry, double midgame, double endgame) {
 
     double eval = (  midgame * entry->phase
                    + endgame * (MidGame - entry->phase) * entry->scale)
@@ -373,36 +395,38 @@ static double LinearEvaluation(TEntry *entry, TVector params, int base) {
     return eval + (entry->turn == WHITE ? Tempo : -Tempo);
 }
 
-static void InitTunerTuples(TEntry *entry, TCoeffs coeffs) {
+static double LinearEvaluation(const TEntry *entry, const TTuple *tuples, TVector params, int base) {
 
-    static int allocs = 0;
-    int length = 0, tidx = 0;
+    double midgame = MgScore(base);
+    double endgame = EgScore(base);
 
-    // Count the needed Coefficients
-    for (int i = 0; i < NTERMS; i++)
-        length += coeffs[i] != 0.0;
-
-    // Allocate additional memory if needed
-    if (length > TupleStackSize) {
-        TupleStackSize = STACKSIZE;
-        TupleStack = calloc(STACKSIZE, sizeof(TTuple));
-        int ttupleMB = STACKSIZE * sizeof(TTuple) / (1 << 20);
-        printf("Allocating [%dMB] x%d\r", ttupleMB, ++allocs);
+    for (int i = 0; i < entry->ntuples; i++) {
+        int termIndex = tuples[i].index;
+        midgame += (double) tuples[i].coeff * params[termIndex][MG];
+        endgame += (double) tuples[i].coeff * params[termIndex][EG];
     }
 
-    // Claim part of the Tuple Stack
-    entry->tuples   = TupleStack;
-    entry->ntuples  = length;
-    TupleStack     += length;
-    TupleStackSize -= length;
+    return PhasedEvaluation(entry, midgame, endgame);
+}
+
+// Stores the non-zero coefficients as tuples, returning how many there are
+static int InitTunerTuples(TTuple *tuples, TCoeffs coeffs) {
+
+    int length = 0;
 
-    // Finally setup each of our TTuples for this TEntry
     for (int i = 0; i < NTERMS; i++)
         if (coeffs[i] != 0.0)
-            entry->tuples[tidx++] = (TTuple) { i, coeffs[i] };
+            tuples[length++] = (TTuple) { i, coeffs[i] };
+
+    return length;
 }
 
-static void InitTunerEntry(TEntry *entry, Position *pos, int *danger) {
+// Number of tuples an entry takes up in the binary dataset
+static int Padded(int ntuples) {
+    return (ntuples + TUPLESTRIDE - 1) / TUPLESTRIDE * TUPLESTRIDE;
+}
+
+static void InitTunerEntry(TEntry *entry, TTuple *tuples, Position *pos, int *danger) {
 
     // Save time by computing phase scalars now
     entry->pfactors[MG] = 0 + pos->phaseValue / 24.0;
@@ -415,7 +439,7 @@ static void InitTunerEntry(TEntry *entry, Position *pos, int *danger) {
 
     // evaluate() -> [[NTERMS][COLOUR_NB]]
     InitCoefficients(coeffs);
-    InitTunerTuples(entry, coeffs);
+    entry->ntuples = InitTunerTuples(tuples, coeffs);
 
     // Save some of the evaluation modifiers
     entry->eval = T.eval;
@@ -424,162 +448,679 @@ static void InitTunerEntry(TEntry *entry, Position *pos, int *danger) {
     *danger = T.danger[WHITE] - T.danger[BLACK];
 }
 
-static void InitTunerEntries(TEntry *entries, TVector baseParams) {
+// Identifies the eval parameters the binary dataset was made with
+static uint64_t ParamsHash(TVector baseParams) {
+
+    uint64_t hash = 14695981039346656037ull;
+
+    for (int i = 0; i < NTERMS; i++)
+        for (int j = MG; j <= EG; j++)
+            hash = (hash ^ (uint64_t)(int64_t)baseParams[i][j]) * 1099511628211ull;
+
+    return hash;
+}
+
+// Converts a text dataset to a binary file holding the header, and then
+// chunks of entries with their tuples. Fens are parsed in order as ParseFen
+// isn't thread safe, while the traced evaluations are done in parallel
+static void ConvertDataset(const TDataset *dataset, const char *binPath, TVector baseParams, uint64_t paramsHash) {
+
+    static Position positions[CONVERTCHUNK];
+    static TEntry entries[CONVERTCHUNK];
+    static TTuple tuples[CONVERTCHUNK][NTERMS];
+    static int dangers[CONVERTCHUNK];
+    static int16_t block[2 * (NTERMS + TUPLESTRIDE)];
 
-    Position pos;
     char line[128];
-    FILE *fin = fopen(DATASET, "r");
+    const char *path = dataset->path;
+    FILE *fin = fopen(path, "r");
 
-    for (int i = 0; i < NPOSITIONS; i++) {
+    // Don't leave an empty binary behind for a dataset that doesn't exist
+    if (!fin) {
+        printf("Cannot open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
 
-        if (fgets(line, 128, fin) == NULL) exit(EXIT_FAILURE);
+    FILE *fout = fopen(binPath, "wb");
+
+    if (!fout) {
+        printf("Cannot open %s\n", binPath);
+        exit(EXIT_FAILURE);
+    }
 
-        // Find the result { W, L, D } => { 1.0, 0.0, 0.5 }
-        if      (strstr(line, "[1.0]")) entries[i].result = 1.0;
-        else if (strstr(line, "[0.5]")) entries[i].result = 0.5;
-        else if (strstr(line, "[0.0]")) entries[i].result = 0.0;
-        else    {printf("Cannot Parse %s\n", line); exit(EXIT_FAILURE);}
+    TFileHeader header = { "WEISSTUN", TUNER_FORMAT_VERSION, NTERMS, TUPLESTRIDE, 0, 0, 0, paramsHash,
+                           dataset->sourceSize, dataset->sourceTime };
+    fwrite(&header, sizeof(TFileHeader), 1, fout);
 
-        TEntry *entry = &entries[i];
-        int danger;
+    while (true) {
 
-        // Set the board with the current FEN and initialize
-        ParseFen(line, &pos);
-        InitTunerEntry(entry, &pos, &danger);
+        int count = 0;
 
-        int coeffEval = LinearEvaluation(entry, baseParams, -danger);
-        int deviation = abs(entry->seval - coeffEval);
+        while (count < CONVERTCHUNK && fgets(line, 128, fin)) {
 
-        if (deviation > 1) {
-            printf("\nDeviation %d between real eval and coeff eval too big: %s", deviation, line);
-            exit(0);
+            // Skip blank lines
+            if (line[strspn(line, " \t\r\n")] == '\0') continue;
+
+            // Find the result { W, L, D } => { 1.0, 0.0, 0.5 }
+            if      (strstr(line, "[1.0]")) entries[count].result = 1.0;
+            else if (strstr(line, "[0.5]")) entries[count].result = 0.5;
+            else if (strstr(line, "[0.0]")) entries[count].result = 0.0;
+            else    {printf("Cannot Parse %s\n", line); fclose(fout), remove(binPath); exit(EXIT_FAILURE);}
+
+            ParseFen(line, &positions[count++]);
+        }
+
+        if (!count) break;
+
+        #pragma omp parallel
+        {
+            #pragma omp for schedule(dynamic, 64)
+            for (int i = 0; i < count; i++)
+                InitTunerEntry(&entries[i], tuples[i], &positions[i], &dangers[i]);
         }
+
+        uint64_t chunkTuples = 0;
+
+        for (int i = 0; i < count; i++) {
+
+            int coeffEval = LinearEvaluation(&entries[i], tuples[i], baseParams, -dangers[i]);
+            int deviation = abs(entries[i].seval - coeffEval);
+
+            if (deviation > 1) {
+                printf("\nDeviation %d between real eval and coeff eval too big: %s", deviation, BoardToFen(&positions[i]));
+                fclose(fout), remove(binPath);
+                exit(EXIT_FAILURE);
+            }
+
+            // The tuples follow all entries of the chunk
+            entries[i].weight = 1.0;
+            entries[i].tupleOffset = (count - i) * sizeof(TEntry) + chunkTuples * 2 * sizeof(int16_t);
+            chunkTuples += Padded(entries[i].ntuples);
+        }
+
+        TChunkHeader chunk = { count, 0, count * sizeof(TEntry) + chunkTuples * 2 * sizeof(int16_t) };
+        fwrite(&chunk, sizeof(TChunkHeader), 1, fout);
+        fwrite(entries, sizeof(TEntry), count, fout);
+
+        for (int i = 0; i < count; i++) {
+
+            const int padded = Padded(entries[i].ntuples);
+
+            for (int j = 0; j < padded; j++) {
+                bool real = j < entries[i].ntuples;
+                block[j]          = real ? tuples[i][j].index : NTERMS;
+                block[padded + j] = real ? tuples[i][j].coeff : 0;
+            }
+
+            fwrite(block, sizeof(int16_t), 2 * padded, fout);
+        }
+
+        header.npositions += count;
+        header.ntuples += chunkTuples;
+
+        printf("\rConverting %s [%" PRIu64 "]", path, header.npositions);
+        fflush(stdout);
     }
+
+    rewind(fout);
+    fwrite(&header, sizeof(TFileHeader), 1, fout);
+
+    fclose(fin);
+
+    if (fclose(fout)) {
+        printf("\nFailed writing %s\n", binPath);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("\nConverted %" PRIu64 " positions with %" PRIu64 " tuples to %s\n", header.npositions, header.ntuples, binPath);
+}
+
+INLINE TEntry *FirstEntry(const TChunkHeader *chunk) {
+    return (TEntry *)(chunk + 1);
+}
+
+INLINE TChunkHeader *NextChunk(const TChunkHeader *chunk) {
+    return (TChunkHeader *)((char *)(chunk + 1) + chunk->size);
+}
+
+// Maps a binary dataset into memory, returns false if it is missing, broken,
+// or was made for different terms or parameters
+static bool LoadDataset(TDataset *dataset, const char *binPath, uint64_t paramsHash) {
+
+    FILE *fin = fopen(binPath, "rb");
+    if (!fin) return false;
+
+    TFileHeader header;
+    bool valid = fread(&header, sizeof(TFileHeader), 1, fin)
+              && !memcmp(header.magic, "WEISSTUN", 8)
+              && header.version     == TUNER_FORMAT_VERSION
+              && header.nterms      == NTERMS
+              && header.tupleStride == TUPLESTRIDE
+              && header.npositions  <= INT32_MAX
+              && header.paramsHash  == paramsHash
+              && header.sourceSize  == dataset->sourceSize
+              && header.sourceTime  == dataset->sourceTime;
+
+    if (!valid) {
+        fclose(fin);
+        return false;
+    }
+
+#if defined(__linux__)
+    struct stat st;
+    fstat(fileno(fin), &st);
+    const size_t size = st.st_size;
+
+    // Private and writable so the weights can be set without touching the file
+    char *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(fin), 0);
+    fclose(fin);
+
+    if (data == MAP_FAILED) return false;
+
+    // Epochs read the whole file in order
+    madvise(data, size, MADV_WILLNEED);
+#else
+    fseek(fin, 0, SEEK_END);
+    const size_t size = ftell(fin);
+
+    char *data = malloc(size);
+    rewind(fin);
+    valid = data && fread(data, size, 1, fin);
+    fclose(fin);
+
+    if (!valid) return free(data), false;
+#endif
+
+    // Check that the chunks add up to the file
+    const char *end = data + size;
+    const TChunkHeader *chunk = (TChunkHeader *)(data + sizeof(TFileHeader));
+    uint64_t npositions = 0;
+
+    while ((const char *)(chunk + 1) <= end && (const char *)NextChunk(chunk) <= end) {
+        npositions += chunk->count;
+        chunk = NextChunk(chunk);
+    }
+
+    if ((const char *)chunk != end || npositions != header.npositions) {
+#if defined(__linux__)
+        munmap(data, size);
+#else
+        free(data);
+#endif
+        return false;
+    }
+
+    dataset->data = data;
+    dataset->size = size;
+    dataset->npositions = npositions;
+
+    printf("Loaded %s (%d positions, %" PRIu64 "MB, weight %g)\n",
+           binPath, dataset->npositions, (uint64_t)(size >> 20), dataset->weight);
+
+    return true;
+}
+
+// Loads each dataset, converting those not done for the current parameters,
+// and collects all their entries in one list
+static TEntry **LoadDatasets(TVector baseParams, int *total) {
+
+    uint64_t paramsHash = ParamsHash(baseParams);
+    char binPath[4096];
+
+    *total = 0;
+
+    for (int i = 0; i < Config.datasetCount; i++) {
+
+        TDataset *dataset = &Config.datasets[i];
+        snprintf(binPath, sizeof(binPath), "%s.bin", dataset->path);
+
+        // The binary is rebuilt when the dataset has changed since it was converted
+        struct stat st;
+        if (!stat(dataset->path, &st))
+            dataset->sourceSize = st.st_size,
+            dataset->sourceTime = st.st_mtime;
+
+        if (!LoadDataset(dataset, binPath, paramsHash)) {
+            ConvertDataset(dataset, binPath, baseParams, paramsHash);
+            if (!LoadDataset(dataset, binPath, paramsHash)) {
+                printf("Failed to load %s\n", binPath);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        if ((int64_t)*total + dataset->npositions > INT32_MAX) {
+            printf("Too many positions\n");
+            exit(EXIT_FAILURE);
+        }
+
+        *total += dataset->npositions;
+    }
+
+    TEntry **entries = malloc(*total * sizeof(TEntry *));
+    TEntry **next = entries;
+
+    for (int i = 0; i < Config.datasetCount; i++) {
+
+        const TDataset *dataset = &Config.datasets[i];
+        const char *end = dataset->data + dataset->size;
+
+        for (TChunkHeader *chunk = (TChunkHeader *)(dataset->data + sizeof(TFileHeader));
+             (char *)chunk < end;
+             chunk = NextChunk(chunk)) {
+
+            for (uint32_t j = 0; j < chunk->count; j++) {
+                TEntry *entry = FirstEntry(chunk) + j;
+
+                // Only copies the pages of weighted datasets
+                if (dataset->weight != 1.0)
+                    entry->weight = dataset->weight;
+
+                *next++ = entry;
+            }
+        }
+    }
+
+    return entries;
 }
 
 static double Sigmoid(double K, double E) {
     return 1.0 / (1.0 + exp(-K * E / 400.0));
 }
 
-static double StaticEvaluationErrors(TEntry * entries, double K) {
+static double StaticEvaluationErrors(TEntry **entries, int count, double K) {
 
-    double total = 0.0;
-    #pragma omp parallel shared(total)
+    const int chunk = MAX(1, count / NPARTITIONS);
+    double total = 0.0, weights = 0.0;
+
+    #pragma omp parallel shared(total, weights)
     {
-        #pragma omp for schedule(static, NPOSITIONS / NPARTITIONS) reduction(+:total)
-        for (int i = 0; i < NPOSITIONS; i++)
-            total += pow(entries[i].result - Sigmoid(K, entries[i].seval), 2);
+        #pragma omp for schedule(static, chunk) reduction(+:total, weights)
+        for (int i = 0; i < count; i++) {
+            total   += entries[i]->weight * pow(entries[i]->result - Sigmoid(K, entries[i]->seval), 2);
+            weights += entries[i]->weight;
+        }
     }
 
-    return total / (double) NPOSITIONS;
+    return total / weights;
 }
 
-static double __attribute__((unused)) ComputeOptimalK(TEntry *entries) {
+static double ComputeOptimalK(TEntry **entries, int count) {
 
-    const double rate = 100, delta = 1e-5, deviation_goal = 1e-6;
-    double K = 2, deviation = 1;
+    const double delta = 1e-5, deviation_goal = 1e-6;
+    double K = 2, deviation, previous = 0, rate = 100;
 
-    while (fabs(deviation) > deviation_goal) {
-        double up   = StaticEvaluationErrors(entries, K + delta);
-        double down = StaticEvaluationErrors(entries, K - delta);
+    do {
+        double up   = StaticEvaluationErrors(entries, count, K + delta);
+        double down = StaticEvaluationErrors(entries, count, K - delta);
         deviation = (up - down) / (2 * delta);
+
+        // Smaller steps once it overshoots, or it can oscillate forever
+        if (deviation * previous < 0) rate /= 2;
+
+        previous = deviation;
         K -= deviation * rate;
-    }
+    } while (fabs(deviation) > deviation_goal);
 
     return K;
 }
 
-static void UpdateSingleGradient(TEntry *entry, TVector gradient, TVector params, double K) {
+// Sums the coefficients times the parameters of an entry's tuples. With AVX2
+// the [MG, EG] pair of each term is gathered as one 64 bit value, four tuples
+// at a time, with the padding tuples adding zero. Wider AVX-512 gathers were
+// slower when tested, so those builds use this as well. Single precision is
+// enough for one evaluation, while the gradient is summed over many positions
+// and is kept in double precision
+#if defined(__AVX2__)
+static void TupleSums(const TEntry *entry, const TFloatVector params, double *mg, double *eg) {
 
-    double E = LinearEvaluation(entry, params, entry->eval);
-    double S = Sigmoid(K, E);
-    double X = (entry->result - S) * S * (1 - S);
+    const int16_t *indices = EntryTuples(entry);
+    const int16_t *coeffs  = indices + Padded(entry->ntuples);
+
+    const __m256i pairUp = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    __m256 sum = _mm256_setzero_ps();
+
+    for (int i = 0; i < entry->ntuples; i += 4) {
+        __m128i index = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(indices + i)));
+        __m128  coeff = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(coeffs + i))));
+
+        __m256 pairs = _mm256_castsi256_ps(_mm256_i32gather_epi64((const long long *)params, index, 8));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_permutevar8x32_ps(_mm256_castps128_ps256(coeff), pairUp), pairs));
+    }
+
+    // Even lanes are midgame, odd lanes endgame
+    __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    sum128 = _mm_add_ps(sum128, _mm_movehl_ps(sum128, sum128));
 
-    double mgBase = X * entry->pfactors[MG];
-    double egBase = X * entry->pfactors[EG];
+    *mg += _mm_cvtss_f32(sum128);
+    *eg += _mm_cvtss_f32(_mm_shuffle_ps(sum128, sum128, 1));
+}
+#else
+static void TupleSums(const TEntry *entry, const TFloatVector params, double *mg, double *eg) {
+
+    const int16_t *indices = EntryTuples(entry);
+    const int16_t *coeffs  = indices + Padded(entry->ntuples);
 
     for (int i = 0; i < entry->ntuples; i++) {
-        int index = entry->tuples[i].index;
-        int coeff = entry->tuples[i].coeff;
+        *mg += (double) coeffs[i] * params[indices[i]][MG];
+        *eg += (double) coeffs[i] * params[indices[i]][EG];
+    }
+}
+#endif
+
+// Adds an entry's share of the gradient. Stays scalar: an AVX2 version that
+// scales four tuples at a time and updates each [MG, EG] pair with one 128 bit
+// add ran no faster, as the time goes to the scattered loads and stores
+static void AddGradient(const TEntry *entry, TVector gradient, double mgBase, double egBase) {
+
+    const int16_t *indices = EntryTuples(entry);
+    const int16_t *coeffs  = indices + Padded(entry->ntuples);
 
-        gradient[index][MG] += mgBase * coeff;
-        gradient[index][EG] += egBase * coeff * entry->scale;
+    for (int i = 0; i < entry->ntuples; i++) {
+        gradient[indices[i]][MG] += mgBase * coeffs[i];
+        gradient[indices[i]][EG] += egBase * coeffs[i];
     }
 }
 
-static void ComputeGradient(TEntry *entries, TVector gradient, TVector params, double K) {
+static double TunedEvaluation(const TEntry *entry, const TFloatVector params) {
+
+    double midgame = MgScore(entry->eval);
+    double endgame = EgScore(entry->eval);
+
+    TupleSums(entry, params, &midgame, &endgame);
+
+    return PhasedEvaluation(entry, midgame, endgame);
+}
+
+// Single precision copy of the parameters, with a zero dummy term for padding
+static void InitFloatParams(TFloatVector floats, TVector params) {
 
-    #pragma omp parallel shared(gradient)
+    for (int i = 0; i < NTERMS; i++) {
+        floats[i][MG] = params[i][MG];
+        floats[i][EG] = params[i][EG];
+    }
+
+    floats[NTERMS][MG] = floats[NTERMS][EG] = 0;
+}
+
+static void UpdateSingleGradient(const TEntry *entry, TVector gradient, const TFloatVector params, double K) {
+
+    double E = TunedEvaluation(entry, params);
+    double S = Sigmoid(K, E);
+    double X = entry->weight * (entry->result - S) * S * (1 - S);
+
+    AddGradient(entry, gradient, X * entry->pfactors[MG], X * entry->pfactors[EG] * entry->scale);
+}
+
+// Sums the gradient of the given positions, returning their total weight
+static double ComputeGradient(TEntry **entries, int count, TVector gradient, TVector params, double K) {
+
+    const int chunk = MAX(1, count / NPARTITIONS);
+    _Alignas(64) TFloatVector floats;
+    InitFloatParams(floats, params);
+
+    double weights = 0.0;
+
+    #pragma omp parallel shared(gradient, weights)
     {
         TVector local = {0};
-        #pragma omp for schedule(static, NPOSITIONS / NPARTITIONS)
-        for (int i = 0; i < NPOSITIONS; i++)
-            UpdateSingleGradient(&entries[i], local, params, K);
+        #pragma omp for schedule(static, chunk) reduction(+:weights)
+        for (int i = 0; i < count; i++) {
+            UpdateSingleGradient(entries[i], local, floats, K);
+            weights += entries[i]->weight;
+        }
 
         for (int i = 0; i < NTERMS; i++) {
+            #pragma omp atomic
             gradient[i][MG] += local[i][MG];
+            #pragma omp atomic
             gradient[i][EG] += local[i][EG];
         }
     }
+
+    return weights;
 }
 
-static double TunedEvaluationErrors(TEntry *entries, TVector params, double K) {
+static double TunedEvaluationErrors(TEntry **entries, int count, TVector params, double K) {
+
+    const int chunk = MAX(1, count / NPARTITIONS);
+    _Alignas(64) TFloatVector floats;
+    InitFloatParams(floats, params);
 
-    double total = 0.0;
+    double total = 0.0, weights = 0.0;
 
-    #pragma omp parallel shared(total)
+    #pragma omp parallel shared(total, weights)
     {
-        #pragma omp for schedule(static, NPOSITIONS / NPARTITIONS) reduction(+:total)
-        for (int i = 0; i < NPOSITIONS; i++)
-            total += pow(entries[i].result - Sigmoid(K, LinearEvaluation(&entries[i], params, entries[i].eval)), 2);
+        #pragma omp for schedule(static, chunk) reduction(+:total, weights)
+        for (int i = 0; i < count; i++) {
+            total   += entries[i]->weight * pow(entries[i]->result - Sigmoid(K, TunedEvaluation(entries[i], floats)), 2);
+            weights += entries[i]->weight;
+        }
     }
 
-    return total / (double) NPOSITIONS;
+    return total / weights;
+}
+
+// Pseudo-random number generator for shuffling the positions
+static uint64_t Rand64() {
+
+    static uint64_t seed = 1070372ull;
+
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+
+    return seed * 2685821657736338717ull;
+}
+
+static void Shuffle(TEntry **entries, int count) {
+
+    for (int i = count - 1; i > 0; i--) {
+        int j = Rand64() % (i + 1);
+        TEntry *tmp = entries[i];
+        entries[i] = entries[j];
+        entries[j] = tmp;
+    }
 }
 
-void Tune() {
+// Takes one ADAM step with the gradient of the given positions
+static void UpdateParams(TEntry **entries, int count, TVector params, TVector momentum, TVector velocity, double K, double rate) {
+
+    const double beta1 = Config.beta1, beta2 = Config.beta2;
+
+    TVector gradient = {0};
+    double weights = ComputeGradient(entries, count, gradient, params, K);
+
+    for (int i = 0; i < NTERMS; i++) {
+        double mg_grad = (-K / 200.0) * gradient[i][MG] / weights;
+        double eg_grad = (-K / 200.0) * gradient[i][EG] / weights;
+
+        momentum[i][MG] = beta1 * momentum[i][MG] + (1.0 - beta1) * mg_grad;
+        momentum[i][EG] = beta1 * momentum[i][EG] + (1.0 - beta1) * eg_grad;
+
+        velocity[i][MG] = beta2 * velocity[i][MG] + (1.0 - beta2) * pow(mg_grad, 2);
+        velocity[i][EG] = beta2 * velocity[i][EG] + (1.0 - beta2) * pow(eg_grad, 2);
+
+        params[i][MG] -= rate * momentum[i][MG] / (1e-8 + sqrt(velocity[i][MG]));
+        params[i][EG] -= rate * momentum[i][EG] / (1e-8 + sqrt(velocity[i][EG]));
+    }
+}
+
+static void PrintUsage() {
+    puts("Usage: weiss tune [option=value ...] dataset[:weight] ...\n");
+    puts("Datasets are text files of fens followed by [1.0], [0.5] or [0.0],");
+    puts("converted to dataset.bin on the first run. Options and defaults:\n");
+    printf("  epochs=%-9d Max number of epochs\n",                        MAXEPOCHS);
+    printf("  report=%-9d Epochs between printing the parameters\n",      REPORTING);
+    printf("  lr=%-13g Learning rate\n",                                  LRRATE);
+    printf("  lrdrop=%-9g Divide the learning rate by this every lrstep\n", LRDROPRATE);
+    printf("  lrstep=%-9d Epochs between learning rate drops\n",          LRSTEPRATE);
+    printf("  beta1=%-10g ADAM momentum coefficient\n",                   BETA_1);
+    printf("  beta2=%-10g ADAM velocity coefficient\n",                   BETA_2);
+    printf("  k=%-14g Sigmoid scaling, 0 to compute the optimal value\n", KVALUE);
+    printf("  batch=%-10d Positions per step, 0 for full batch\n",        BATCHSIZE);
+    printf("  validation=%-5d Positions held out to measure the error on\n", NVALIDATION);
+    printf("  validatefreq=%-3d Steps between error reports with batches\n", VALIDATEFREQ);
+}
+
+static void InvalidValue(const char *name, const char *value) {
+    printf("Invalid value %s for %s\n\n", value, name);
+    PrintUsage();
+    exit(EXIT_FAILURE);
+}
+
+// Option values must be numbers with nothing trailing, like dataset weights
+static int ParseInt(const char *name, const char *value) {
+    char *end;
+    long result = strtol(value, &end, 10);
+    if (!*value || *end || result < INT_MIN || result > INT_MAX)
+        InvalidValue(name, value);
+    return result;
+}
+
+static double ParseDouble(const char *name, const char *value) {
+    char *end;
+    double result = strtod(value, &end);
+    if (!*value || *end || !isfinite(result))
+        InvalidValue(name, value);
+    return result;
+}
+
+// Reads the datasets and options, exiting with a usage message on errors
+static void ParseConfig(int argc, char **argv) {
+
+    for (int i = 2; i < argc; ++i) {
+
+        char *name = argv[i];
+        char *value = strchr(name, '=');
+
+        // Datasets are path[:weight], the weight only if it is a number
+        if (!value) {
+
+            if (Config.datasetCount == MAXDATASETS) {
+                printf("At most %d datasets can be used\n", MAXDATASETS);
+                exit(EXIT_FAILURE);
+            }
+
+            TDataset *dataset = &Config.datasets[Config.datasetCount++];
+            char *colon = strrchr(name, ':'), *end;
+            dataset->path = name;
+            dataset->weight = 1.0;
+
+            if (colon && colon[1]) {
+                double weight = strtod(colon + 1, &end);
+                if (!*end && weight > 0)
+                    dataset->weight = weight, *colon = '\0';
+            }
+            continue;
+        }
+
+        *value++ = '\0';
+
+        if      (!strcmp(name, "epochs"))       Config.epochs       = ParseInt(name, value);
+        else if (!strcmp(name, "report"))       Config.reporting    = ParseInt(name, value);
+        else if (!strcmp(name, "lr"))           Config.lr           = ParseDouble(name, value);
+        else if (!strcmp(name, "lrdrop"))       Config.lrDrop       = ParseDouble(name, value);
+        else if (!strcmp(name, "lrstep"))       Config.lrStep       = ParseInt(name, value);
+        else if (!strcmp(name, "beta1"))        Config.beta1        = ParseDouble(name, value);
+        else if (!strcmp(name, "beta2"))        Config.beta2        = ParseDouble(name, value);
+        else if (!strcmp(name, "k"))            Config.K            = ParseDouble(name, value);
+        else if (!strcmp(name, "batch"))        Config.batchSize    = ParseInt(name, value);
+        else if (!strcmp(name, "validation"))   Config.validation   = ParseInt(name, value);
+        else if (!strcmp(name, "validatefreq")) Config.validateFreq = ParseInt(name, value);
+        else {
+            printf("Unknown option %s\n\n", name);
+            PrintUsage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (   !Config.datasetCount
+        || Config.epochs < 1 || Config.reporting < 1 || Config.lrStep < 1
+        || Config.batchSize < 0 || Config.validation < 0 || Config.validateFreq < 1) {
+        PrintUsage();
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Tune(int argc, char **argv) {
 
     TVector baseParams = {0}, params = {0}, momentum = {0}, velocity = {0};
-    double K, error, rate = LRRATE;
-    TEntry *entries = calloc(NPOSITIONS, sizeof(TEntry));
-    TupleStack      = calloc(STACKSIZE,  sizeof(TTuple));
+    double K, error, rate;
+    int npositions;
 
-    printf("Tuning %d terms using %d positions from %s\n", NTERMS, NPOSITIONS, DATASET);
+    ParseConfig(argc, argv);
     InitBaseParams(baseParams);
-    InitTunerEntries(entries, baseParams);
-    printf("Allocated:\n");
-    printf("Optimal K...\r");
-    // K = ComputeOptimalK(entries);
-    K = 2.25;
+
+    // Convert each dataset unless it was already done for the current parameters
+    TEntry **entries = LoadDatasets(baseParams, &npositions);
+
+    if (Config.validation >= npositions) {
+        printf("Cannot hold out %d of %d positions\n", Config.validation, npositions);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Tuning %d terms using %d positions from %d datasets\n", NTERMS, npositions, Config.datasetCount);
+
+    // The last positions of a random order are held out, the error is
+    // measured on them, or on the training positions if there are none
+    const int ntraining = npositions - Config.validation;
+    const int batchSize = Config.batchSize ? MIN(Config.batchSize, ntraining) : ntraining;
+
+    if (Config.validation)
+        Shuffle(entries, npositions);
+
+    K = Config.K;
+    rate = Config.lr;
+
+    // K is fitted to the training positions only, leaving validation unseen
+    if (!K) {
+        printf("Optimal K...\r");
+        K = ComputeOptimalK(entries, ntraining);
+    }
     printf("Optimal K: %g\n\n", K);
 
-    for (int epoch = 1; epoch <= MAXEPOCHS; epoch++) {
+    TEntry **validation    = Config.validation ? entries + ntraining : entries;
+    const int nvalidation = Config.validation ? Config.validation : ntraining;
 
-        TVector gradient = {0};
-        ComputeGradient(entries, gradient, params, K);
+    if (Config.batchSize)
+        printf("Mini-batches of %d positions, %d held out for validation\n\n", batchSize, Config.validation);
 
-        for (int i = 0; i < NTERMS; i++) {
-            double mg_grad = (-K / 200.0) * gradient[i][MG] / NPOSITIONS;
-            double eg_grad = (-K / 200.0) * gradient[i][EG] / NPOSITIONS;
+    // Throughput is measured in training positions since the last report
+    TimePoint reportTime = Now();
+    uint64_t reportPositions = 0;
 
-            momentum[i][MG] = BETA_1 * momentum[i][MG] + (1.0 - BETA_1) * mg_grad;
-            momentum[i][EG] = BETA_1 * momentum[i][EG] + (1.0 - BETA_1) * eg_grad;
+    for (int epoch = 1, step = 0; epoch <= Config.epochs; epoch++) {
 
-            velocity[i][MG] = BETA_2 * velocity[i][MG] + (1.0 - BETA_2) * pow(mg_grad, 2);
-            velocity[i][EG] = BETA_2 * velocity[i][EG] + (1.0 - BETA_2) * pow(eg_grad, 2);
+        // Each epoch is one pass over the training positions in a new order
+        if (Config.batchSize)
+            Shuffle(entries, ntraining);
 
-            params[i][MG] -= rate * momentum[i][MG] / (1e-8 + sqrt(velocity[i][MG]));
-            params[i][EG] -= rate * momentum[i][EG] / (1e-8 + sqrt(velocity[i][EG]));
-        }
+        for (int start = 0; start + batchSize <= ntraining; start += batchSize) {
 
-        error = TunedEvaluationErrors(entries, params, K);
-        printf("\rEpoch [%d] Error = [%.8f], Rate = [%g]", epoch, error, rate);
-        if (epoch % 10 == 0) puts("");
+            UpdateParams(entries + start, batchSize, params, momentum, velocity, K, rate);
+            reportPositions += batchSize;
+
+            if (Config.batchSize && ++step % Config.validateFreq) continue;
+
+            error = TunedEvaluationErrors(validation, nvalidation, params, K);
+
+            double speed = 1000.0 * reportPositions / MAX(1, TimeSince(reportTime));
+            reportTime = Now(), reportPositions = 0;
+
+            if (Config.batchSize)
+                printf("Epoch [%d] Step [%d] Error = [%.8f], Rate = [%g], Speed = [%.0f pos/s]\n", epoch, step, error, rate, speed);
+            else {
+                printf("\rEpoch [%d] Error = [%.8f], Rate = [%g], Speed = [%.0f pos/s]", epoch, error, rate, speed);
+                if (epoch % 10 == 0) puts("");
+            }
+        }
 
         // Pre-scheduled Learning Rate drops
-        if (epoch % LRSTEPRATE == 0) rate = rate / LRDROPRATE;
-        if (epoch % REPORTING == 0) PrintParameters(params, baseParams);
+        if (epoch % Config.lrStep == 0) rate = rate / Config.lrDrop;
+        if (epoch % Config.reporting == 0) PrintParameters(params, baseParams);
     }
+
+    free(entries);
 }
 
 #endif
@@ -39,27 +39,28 @@
 #define TraceDanger(d) T.danger[color] = d
 
 
-// #define DATASET      "../../Datasets/Andrew/BIG.book"
-// #define NPOSITIONS   ( 42484641) // Total FENS in the book
-
-#define DATASET      "../../Datasets/lichess-big3-resolved.book"
-#define NPOSITIONS   ( 7153652) // Total FENS in the book
-
-// #define DATASET      "../../Datasets/Andrew/COMBO.book"
-// #define NPOSITIONS   (14669229) // Total FENS in the book
+// Each dataset is converted to a binary file next to it on the first run
+#define TUNER_FORMAT_VERSION 4
 
 
 #define NTERMS       (     552) // Number of terms being tuned
+#define NPARTITIONS  (      64) // Total thread partitions
+#define CONVERTCHUNK (    4096) // Positions converted in parallel at a time
+#define TUPLESTRIDE  (       4) // Tuples of an entry are padded to a multiple of this
+#define MAXDATASETS  (      16) // Max number of datasets combined in one run
+
+// Defaults of the options that can be given on the command line
 #define MAXEPOCHS    (   10000) // Max number of epochs allowed
 #define REPORTING    (      50) // How often to print the new parameters
-#define NPARTITIONS  (      64) // Total thread partitions
 #define LRRATE       (    0.1) // Learning rate
 #define LRDROPRATE   (    1.00) // Cut LR by this each LR-step
 #define LRSTEPRATE   (     250) // Cut LR after this many epochs
 #define BETA_1       (     0.9) // ADAM Momemtum Coefficient
 #define BETA_2       (   0.999) // ADAM Velocity Coefficient
-
-#define STACKSIZE ((int)((double) NPOSITIONS * NTERMS / 64))
+#define KVALUE       (    2.25) // Sigmoid scaling, 0 to compute the optimal value
+#define BATCHSIZE    (       0) // Positions per step, 0 for full batch
+#define NVALIDATION  (       0) // Positions held out to measure the error on
+#define VALIDATEFREQ (     100) // Steps between error reports with mini-batches
 
 
 typedef struct EvalTrace {
@@ -106,23 +107,68 @@ typedef struct TTuple {
     int16_t index, coeff;
 } TTuple;
 
+// Stored as is in the binary dataset. The tuples of each entry are a block
+// of indices followed by a block of coefficients, both padded to TUPLESTRIDE
+// with zero coefficients on a dummy term so they can be read a full vector
+// at a time. They are found by an offset from the entry itself, so entries
+// from any number of datasets can be mixed
 typedef struct TEntry {
     int16_t seval, phase, turn, ntuples;
     int eval;
+    float weight; // Set from the dataset's weight when loaded
     double result, scale, pfactors[2];
-    TTuple *tuples;
+    int64_t tupleOffset;
 } TEntry;
 
+typedef struct TFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nterms;
+    uint32_t tupleStride;
+    uint32_t padding;
+    uint64_t npositions;
+    uint64_t ntuples; // Including padding
+    uint64_t paramsHash; // The tuples depend on the current eval parameters
+    uint64_t sourceSize; // Size and modification time of the dataset
+    int64_t sourceTime;  // the binary was converted from
+} TFileHeader;
+
+// The header is followed by chunks of up to CONVERTCHUNK entries and their tuples
+typedef struct TChunkHeader {
+    uint32_t count;
+    uint32_t padding;
+    uint64_t size; // Bytes of entries and tuples following the chunk header
+} TChunkHeader;
+
+typedef struct TDataset {
+    char *path;
+    double weight;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    char *data;
+    size_t size;
+    int npositions;
+} TDataset;
+
+typedef struct TConfig {
+    int epochs, reporting, lrStep;
+    double lr, lrDrop, beta1, beta2, K;
+    int batchSize, validation, validateFreq;
+    int datasetCount;
+    TDataset datasets[MAXDATASETS];
+} TConfig;
+
 typedef double TCoeffs[NTERMS];
 typedef double TVector[NTERMS][2];
 typedef int TIntVector[NTERMS][2];
+typedef float TFloatVector[NTERMS + 1][2];
 
 
-extern EvalTrace T;
+extern _Thread_local EvalTrace T;
 
 
 // Runs the tuner
-void Tune();
+void Tune(int argc, char **argv);
 
 #else
 #define TRACE (0)
@@ -30,7 +30,36 @@
 #define CLAMP(x, low, high)  (MIN((high), MAX((x), (low))))
 
 #define INLINE static inline __attribute__((always_inline))
-#define CONSTR(prio) static __attribute__((constructor (1000 + prio))) void
+
+// DISPATCH builds link one copy of the engine per instruction set, and the
+// constructors of every copy would run. main runs the chosen copy's instead
+#ifdef DISPATCH
+    #define CONSTR(prio) void
+    void InitDistance();
+    void InitHashKeys();
+    void InitPSQT();
+    void InitReductions();
+    void InitBitboards();
+    void InitEndgames();
+    void InitCuckoo();
+#else
+    #define CONSTR(prio) static __attribute__((constructor (1000 + prio))) void
+#endif
+
+// Lookup tables computed at startup are compiled in as constants with PREGEN
+#ifdef PREGEN
+    #define TABLE const
+#else
+    #define TABLE
+#endif
+
+// Hot per-thread counters get a cache line of their own, UNPADDED
+// builds leave them packed to compare the nps with bench-smp
+#ifdef UNPADDED
+    #define CACHE_PAD
+#else
+    #define CACHE_PAD _Alignas(64)
+#endif
 
 #define loadRelaxed(x) atomic_load_explicit(&(x), memory_order_relaxed)
 
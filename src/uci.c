@@ -19,14 +19,18 @@
 #include <stddef.h>
 #include <stdlib.h>
 
-#include "pyrrhic/tbprobe.h"
 #include "noobprobe/noobprobe.h"
 #include "onlinesyzygy/onlinesyzygy.h"
 #include "tuner/tuner.h"
 #include "board.h"
+#include "cpu.h"
+#include "gentables.h"
 #include "makemove.h"
 #include "move.h"
+#include "nnue.h"
+#include "numa.h"
 #include "search.h"
+#include "syzygy.h"
 #include "tests.h"
 #include "threads.h"
 #include "time.h"
@@ -99,20 +103,45 @@ static void Pos(Position *pos, char *str) {
     pos->nodes = 0;
 }
 
+static char HashFile[INPUT_SIZE] = "weiss.hash";
+
+// Restarts threads with new NUMA binding or cpu pinning, and reallocates
+// the TT so it is spread over the nodes when first touched by them
+static void RebindThreads() {
+    InitThreads(Threads->count);
+    TT.currentMB = 0;
+    puts("info string Hash will be reallocated after next 'isready'.");
+}
+
 // Parses a 'setoption' and updates settings
 static void SetOption(char *str) {
 
     char *optionName  = strstr(str, "name") + 5;
-    char *optionValue = strstr(str, "value") + 6;
+    char *optionValue = strstr(str, "value");
+
+    // Buttons have no value
+    optionValue = optionValue ? optionValue + 6 : "";
 
     #define OptionNameIs(name) (!strncmp(optionName, name, strlen(name)))
     #define BooleanValue       (!strncmp(optionValue, "true", 4))
     #define IntValue           (atoi(optionValue))
 
-    if      (OptionNameIs("Hash"         )) RequestTTSize(IntValue);
+    if      (OptionNameIs("HashFile"     )) strcpy(HashFile, optionValue);
+    else if (OptionNameIs("SaveHash"     )) SaveTT(HashFile);
+    else if (OptionNameIs("LoadHash"     )) LoadTT(HashFile);
+    else if (OptionNameIs("Hash"         )) RequestTTSize(IntValue);
+    else if (OptionNameIs("EvalFile"     )) LoadNetwork(optionValue), ResetThreads();
+    else if (OptionNameIs("PawnHashShared")) PawnCacheShared = BooleanValue, InitPawnCaches();
+    else if (OptionNameIs("PawnHash"     )) PawnCacheMB     = IntValue,     InitPawnCaches();
     else if (OptionNameIs("Threads"      )) InitThreads(IntValue);
-    else if (OptionNameIs("SyzygyPath"   )) tb_init(optionValue);
+    else if (OptionNameIs("NumaBind"     )) NumaBind  = BooleanValue, RebindThreads();
+    else if (OptionNameIs("ThreadPinning")) PinPolicy = ParsePinPolicy(optionValue), RebindThreads();
+    else if (OptionNameIs("SyzygyPath"   )) InitSyzygy(optionValue);
+    else if (OptionNameIs("SyzygyCache"  )) SyzygyCacheMB  = IntValue, InitSyzygyCache();
+    else if (OptionNameIs("SyzygyProbeDepth")) SyzygyProbeDepth = IntValue;
+    else if (OptionNameIs("SyzygyProbeLimit")) SyzygyProbeLimit = IntValue;
     else if (OptionNameIs("MultiPV"      )) Limits.multiPV = IntValue;
+    else if (OptionNameIs("PerftHash"    )) PerftHashMB    = IntValue;
     else if (OptionNameIs("NoobBookLimit")) NoobLimit      = IntValue;
     else if (OptionNameIs("NoobBookMode" )) NoobBookSetMode(optionValue);
     else if (OptionNameIs("NoobBook"     )) NoobBook       = BooleanValue;
@@ -128,14 +157,27 @@ static void Info() {
     printf("id name %s\n", NAME);
     printf("id author Terje Kirstihagen\n");
     printf("option name Hash type spin default %d min %d max %d\n", HASH_DEFAULT, HASH_MIN, HASH_MAX);
+    printf("option name HashFile type string default weiss.hash\n");
+    printf("option name SaveHash type button\n");
+    printf("option name LoadHash type button\n");
     printf("option name Threads type spin default %d min %d max %d\n", 1, 1, 2048);
+    printf("option name EvalFile type string default <empty>\n");
+    printf("option name PawnHash type spin default %d min 1 max 1024\n", PAWN_CACHE_DEFAULT);
+    printf("option name PawnHashShared type check default false\n");
+    printf("option name NumaBind type check default false\n");
+    printf("option name ThreadPinning type combo default none var none var compact var scatter var skipsmt\n");
     printf("option name SyzygyPath type string default <empty>\n");
+    printf("option name SyzygyCache type spin default %d min 0 max 4096\n", SYZYGY_CACHE_DEFAULT);
+    printf("option name SyzygyProbeDepth type spin default 0 min 0 max %d\n", MAX_PLY);
+    printf("option name SyzygyProbeLimit type spin default 7 min 0 max 7\n");
     printf("option name MultiPV type spin default 1 min 1 max %d\n", MULTI_PV_MAX);
+    printf("option name PerftHash type spin default 0 min 0 max 65536\n");
     printf("option name UCI_Chess960 type check default false\n");
     printf("option name NoobBook type check default false\n");
     printf("option name NoobBookMode type string default <best>\n");
     printf("option name NoobBookLimit type spin default 0 min 0 max 1000\n");
     printf("option name OnlineSyzygy type check default false\n");
+    printf("info string Using %s\n", CPUPath());
     printf("uciok\n"); fflush(stdout);
 }
 
@@ -169,17 +211,46 @@ static int HashInput(char *str) {
     return hash;
 }
 
+#ifdef DISPATCH
+// Runs the startup initialisers in constructor priority order
+static void RunConstructors() {
+#ifndef PREGEN
+    InitDistance();
+    InitHashKeys();
+    InitPSQT();
+    InitReductions();
+#endif
+    InitBitboards();
+#ifndef PREGEN
+    InitEndgames();
+    InitCuckoo();
+#endif
+}
+#endif
+
 // Sets up the engine and follows UCI protocol commands
 int main(int argc, char **argv) {
 
+#ifdef DISPATCH
+    RunConstructors();
+#endif
+
+    // Print lookup tables for PREGEN builds
+    if (argc > 1 && strstr(argv[1], "gentables"))
+        return GenerateTables(), 0;
+
     // Benchmark
+    if (argc > 1 && strstr(argv[1], "perft"))
+        return PerftBenchmark(argc, argv) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (argc > 1 && strstr(argv[1], "bench-smp"))
+        return SMPBenchmark(argc, argv), 0;
     if (argc > 1 && strstr(argv[1], "bench"))
         return Benchmark(argc, argv), 0;
 
     // Tuner
 #ifdef TUNE
     if (argc > 1 && strstr(argv[1], "tune"))
-        return Tune(), 0;
+        return Tune(argc, argv), 0;
 #endif
 
     // Init engine
@@ -199,11 +270,12 @@ int main(int argc, char **argv) {
             case UCINEWGAME : NewGame();      break;
             case STOP       : Stop();         break;
             case QUIT       : Stop();         return 0;
-#ifdef DEV
             // Non-UCI commands
+            case PERFT      : Perft(str, false); break;
+            case DIVIDE     : Perft(str, true);  break;
+#ifdef DEV
             case EVAL       : PrintEval(&pos);  break;
             case PRINT      : PrintBoard(&pos); break;
-            case PERFT      : Perft(str);       break;
 #endif
         }
     }
@@ -218,6 +290,8 @@ INLINE int MateScore(const int score) {
 // Print thinking
 void PrintThinking(const Thread *thread, int alpha, int beta) {
 
+    if (Limits.quiet) return;
+
     const Position *pos = &thread->pos;
 
     TimePoint elapsed = TimeSince(Limits.start);
@@ -226,9 +300,7 @@ void PrintThinking(const Thread *thread, int alpha, int beta) {
     int hashFull      = HashFull();
     int nps           = (int)(1000 * nodes / (elapsed + 1));
 
-    Depth seldepth = 128;
-    for (; seldepth > 0; --seldepth)
-        if (history(seldepth-1).key != 0) break;
+    Depth seldepth = SelDepth(pos);
 
     for (int i = 0; i < Limits.multiPV; ++i) {
 
@@ -267,8 +339,62 @@ void PrintThinking(const Thread *thread, int alpha, int beta) {
     fflush(stdout);
 }
 
+#ifdef STATS
+// Prints the search statistics of all threads
+static void PrintStats() {
+
+    #define Total(field) ThreadTotal(stats.field)
+    #define Rate(a, b) (100.0 * Total(a) / MAX(1, Total(b)))
+
+    printf("info string stats tt cutoffs %" PRIu64 " (%.2f%% of nodes)\n",
+           Total(ttCutoffs), 100.0 * Total(ttCutoffs) / MAX(1, TotalNodes()));
+    printf("info string stats rfp cutoffs %" PRIu64 " (%.2f%% of %" PRIu64 " prunable nodes)\n",
+           Total(rfpCutoffs), Rate(rfpCutoffs, pruningNodes), Total(pruningNodes));
+    printf("info string stats null move tries %" PRIu64 " cutoffs %" PRIu64 " (%.2f%%)\n",
+           Total(nullMoveTries), Total(nullMoveCutoffs), Rate(nullMoveCutoffs, nullMoveTries));
+    printf("info string stats probcut tries %" PRIu64 " cutoffs %" PRIu64 " (%.2f%%)\n",
+           Total(probCutTries), Total(probCutCutoffs), Rate(probCutCutoffs, probCutTries));
+    printf("info string stats pruned moves history %" PRIu64 " see %" PRIu64 "\n",
+           Total(historyPruned), Total(seePruned));
+    printf("info string stats singular tries %" PRIu64 " single %" PRIu64 " double %" PRIu64
+           " multicut %" PRIu64 " negative %" PRIu64 "\n",
+           Total(singularTries), Total(singularExtensions[0]), Total(singularExtensions[1]),
+           Total(multiCuts), Total(negativeExtensions));
+    printf("info string stats lmr searches %" PRIu64 " re-searches %" PRIu64 " (%.2f%%)\n",
+           Total(lmrSearches), Total(lmrResearches), Rate(lmrResearches, lmrSearches));
+    printf("info string stats beta cutoffs %" PRIu64 " first move %" PRIu64 " (%.2f%%)\n",
+           Total(betaCutoffs), Total(firstMoveCutoffs), Rate(firstMoveCutoffs, betaCutoffs));
+
+    #undef Total
+    #undef Rate
+}
+#endif
+
 // Print conclusion of search
 void PrintConclusion(const Thread *thread) {
+
+    if (Limits.quiet) return;
+
+    uint64_t tbProbes      = ThreadTotal(counters.tbProbes);
+    uint64_t tbCacheProbes = ThreadTotal(counters.tbCacheProbes);
+    uint64_t tbCacheHits   = ThreadTotal(counters.tbCacheHits);
+
+    // Probe time is summed over all threads
+    if (tbProbes || tbCacheProbes)
+        printf("info string syzygy probes %" PRIu64 " stalled %.1fms, cache hits %" PRIu64 " of %" PRIu64 " (%.1f%%)\n",
+               tbProbes, ThreadTotal(counters.tbProbeNs) / 1e6,
+               tbCacheHits, tbCacheProbes, 100.0 * tbCacheHits / MAX(1, tbCacheProbes));
+
+#ifdef DEV
+    printf("info string tt torn entries %" PRIu64 "\n", (uint64_t)TT.tornEntries);
+    printf("info string pawn cache hits %" PRIu64 " misses %" PRIu64 "\n",
+           ThreadTotal(pawnCache.hits), ThreadTotal(pawnCache.misses));
+    printf("info string eval cache hits %" PRIu64 " misses %" PRIu64 "\n",
+           ThreadTotal(evalCache.hits), ThreadTotal(evalCache.misses));
+#endif
+#ifdef STATS
+    PrintStats();
+#endif
     printf("bestmove %s\n", MoveToStr(thread->rootMoves[0].move));
     fflush(stdout);
 }